@@ -25,6 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <stdint.h>
 #include <string.h>
 #include <array>
+#include <random>
 
 #undef min
 #undef max
@@ -107,6 +108,12 @@ inline float RandomFloat(float min, float max)
 	return min + rand() / (RAND_MAX / (max - min));
 }
 
+/// @brief Like RandomFloat, but with a caller owned generator, so the global rand() state shared with the engine isn't touched.
+inline float RandomFloat(std::minstd_rand &generator, float min, float max)
+{
+	return min + (generator() - std::minstd_rand::min()) / (float(std::minstd_rand::max() - std::minstd_rand::min()) / (max - min));
+}
+
 typedef union {
 	float f;
 	int i;
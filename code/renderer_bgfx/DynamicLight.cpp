@@ -36,6 +36,32 @@ DynamicLightManager::DynamicLightManager() : nLights_(0)
 
 	// Clamp and filter are just for debug drawing. Sampling uses texel fetch.
 	lightsTexture_ = bgfx::createTexture2D(lightsTextureSize_, lightsTextureSize_, false, 1, bgfx::TextureFormat::RGBA32F, BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
+
+	// Worker threads for light assignment.
+	SDL_AtomicSet(&workersQuit_, 0);
+	const int nWorkers = g_cvars.dynamicLightThreads.getInt();
+
+	if (nWorkers > 0)
+	{
+		workersDone_ = SDL_CreateSemaphore(0);
+
+		for (int i = 0; i < nWorkers; i++)
+		{
+			auto worker = std::make_unique<AssignWorker>();
+			worker->manager = this;
+			worker->start = SDL_CreateSemaphore(0);
+			worker->thread = SDL_CreateThread(AssignWorkerThread, "DynamicLightAssign", worker.get());
+
+			if (!worker->thread)
+			{
+				interface::PrintWarningf("Error creating dlight assignment thread: %s\n", SDL_GetError());
+				SDL_DestroySemaphore(worker->start);
+				break;
+			}
+
+			workers_.push_back(std::move(worker));
+		}
+	}
 }
 
 DynamicLightManager::~DynamicLightManager()
@@ -47,13 +73,30 @@ DynamicLightManager::~DynamicLightManager()
 	}
 
 	bgfx::destroy(lightsTexture_);
+
+	// Wake the workers up so they see the quit flag.
+	SDL_AtomicSet(&workersQuit_, 1);
+
+	for (auto &worker : workers_)
+	{
+		SDL_SemPost(worker->start);
+		SDL_WaitThread(worker->thread, nullptr);
+		SDL_DestroySemaphore(worker->start);
+	}
+
+	if (workersDone_)
+		SDL_DestroySemaphore(workersDone_);
 }
 
 void DynamicLightManager::add(uint32_t frameNo, const DynamicLight &light)
 {
-	if (nLights_ == maxLights - 1)
+	if (nLights_ == maxLights)
 	{
-		interface::PrintWarningf("Hit maximum dlights\n");
+		// Only warn once per frame, there may be a lot of these.
+		if (!hitMaxLights_)
+			interface::PrintWarningf("Hit maximum dlights (%u)\n", (uint32_t)maxLights);
+
+		hitMaxLights_ = true;
 		return;
 	}
 
@@ -65,6 +108,7 @@ void DynamicLightManager::add(uint32_t frameNo, const DynamicLight &light)
 void DynamicLightManager::clear()
 {
 	nLights_ = 0;
+	hitMaxLights_ = false;
 }
 
 void DynamicLightManager::contribute(uint32_t frameNo, vec3 position, vec3 *color, vec3 *direction) const
@@ -74,7 +118,7 @@ void DynamicLightManager::contribute(uint32_t frameNo, vec3 position, vec3 *colo
 	const float DLIGHT_AT_RADIUS = 16; // at the edge of a dlight's influence, this amount of light will be added
 	const float DLIGHT_MINIMUM_RADIUS = 16; // never calculate a range less than this to prevent huge light numbers
 
-	for (uint8_t i = 0; i < nLights_; i++)
+	for (uint16_t i = 0; i < nLights_; i++)
 	{
 		const DynamicLight &dl = lights_[frameNo % BGFX_NUM_BUFFER_FRAMES][i];
 		vec3 dir = dl.position_type.xyz() - position;
@@ -102,20 +146,25 @@ void DynamicLightManager::initializeGrid()
 	interface::Printf("dlight grid size is %ux%ux%u\n", gridSize_.x, gridSize_.y, gridSize_.z);
 	gridOffset_ = vec3::empty - world::GetBounds().min;
 
-	// Cells texture.
-	cellsTextureSize_ = util::CalculateSmallestPowerOfTwoTextureSize((int)gridSize_.x * (int)gridSize_.y * (int)gridSize_.z);
+	// Cells texture. World grid cells first, then view space clusters.
+	nGridCells_ = (size_t)gridSize_.x * (size_t)gridSize_.y * (size_t)gridSize_.z;
+	cellsTextureSize_ = util::CalculateSmallestPowerOfTwoTextureSize(int(nGridCells_ + nClusters));
 	interface::Printf("dlight cells texture size is %ux%u\n", cellsTextureSize_, cellsTextureSize_);
-	cellsTexture_ = bgfx::createTexture2D(cellsTextureSize_, cellsTextureSize_, false, 1, bgfx::TextureFormat::R16U, BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
+	cellsTexture_ = bgfx::createTexture2D(cellsTextureSize_, cellsTextureSize_, false, 1, bgfx::TextureFormat::R32U, BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
 
 	for (int i = 0; i < BGFX_NUM_BUFFER_FRAMES; i++)
 	{
-		cellsTextureData_[i].resize(cellsTextureSize_ * cellsTextureSize_);
+		cellsTextureData_[i].assign(cellsTextureSize_ * cellsTextureSize_, 0);
+		dirtyCells_[i] = CellRange();
 	}
 
+	uploadedCells_ = CellRange();
+	texturesValid_ = false;
+
 	// Indices textures.
 	indicesTextureSize_ = 512;
 	interface::Printf("dlight indices texture size is %ux%u\n", indicesTextureSize_, indicesTextureSize_);
-	indicesTexture_ = bgfx::createTexture2D(indicesTextureSize_, indicesTextureSize_, false, 1, bgfx::TextureFormat::R8U, BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
+	indicesTexture_ = bgfx::createTexture2D(indicesTextureSize_, indicesTextureSize_, false, 1, bgfx::TextureFormat::R16U, BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP | BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MAG_POINT);
 
 	for (int i = 0; i < BGFX_NUM_BUFFER_FRAMES; i++)
 	{
@@ -125,20 +174,348 @@ void DynamicLightManager::initializeGrid()
 	assignedLights_.reserve(512); // Arbitrary initial size.
 }
 
-void DynamicLightManager::updateTextures(uint32_t frameNo)
+void DynamicLightManager::updateTextures(uint32_t frameNo, vec3 cameraPosition, const mat3 &cameraRotation, vec2 fov)
 {
 	assert(world::IsLoaded());
 	PROFILE_SCOPED(DynamicLightManager::updateTextures)
 	const uint32_t buffer = frameNo % BGFX_NUM_BUFFER_FRAMES;
+	const bool useClusters = g_cvars.dynamicLightClusters.getBool();
+	uploadedBytes_ = 0;
+
+	// Skip everything if the textures already contain this light set. Clusters are view dependent, so the camera has to match too.
+	if (texturesValid_ && nLights_ == nUploadedLights_ && useClusters == clustersValid_ && memcmp(lights_[buffer], uploadedLights_, nLights_ * sizeof(DynamicLight)) == 0)
+	{
+		// Empty cells don't depend on the camera.
+		if (nLights_ == 0 || !useClusters || (cameraPosition == uploadedCameraPosition_ && memcmp(&cameraRotation, &uploadedCameraRotation_, sizeof(mat3)) == 0 && fov == uploadedCameraFov_))
+		{
+			printStats();
+			return;
+		}
+	}
+
+	memcpy(uploadedLights_, lights_[buffer], nLights_ * sizeof(DynamicLight));
+	nUploadedLights_ = nLights_;
+	uploadedCameraPosition_ = cameraPosition;
+	uploadedCameraRotation_ = cameraRotation;
+	uploadedCameraFov_ = fov;
 
 	// Assign lights to cells.
 	PROFILE_BEGIN(AssignLights)
+	assign(buffer, cameraPosition, cameraRotation, fov, useClusters);
+	PROFILE_END // AssignLights
+
+	// Fill cells and indices texture data.
+	// This buffer was last filled BGFX_NUM_BUFFER_FRAMES frames ago. Only the cells written then need clearing.
+	std::vector<uint32_t> &cells = cellsTextureData_[buffer];
+	CellRange &dirtyCells = dirtyCells_[buffer];
+
+	if (!dirtyCells.isEmpty())
+	{
+		memset(&cells[dirtyCells.first], 0, (dirtyCells.last - dirtyCells.first) * sizeof(uint32_t));
+	}
+
+	dirtyCells = CellRange();
+
+	// Make sure the first index uses num 0, so all empty cells can use it.
+	std::vector<uint16_t> &indices = indicesTextureData_[buffer];
+	uint32_t indicesOffset = 0;
+	indices[indicesOffset++] = 0; // Empty cells will point here.
+	size_t currentCellIndex = 0;
+	uint32_t indicesNumLightsOffset = 0;
+
+	for (size_t i = 0; i < assignedLights_.size(); i++)
+	{
+		// A new cell needs room for the count and one index.
+		if (indicesOffset + 2 > indices.size())
+		{
+			interface::PrintWarningf("Too many assigned lights.\n");
+			break;
+		}
+
+		size_t cellIndex;
+		uint16_t lightIndex;
+		decodeAssignedLight(assignedLights_[i], &cellIndex, &lightIndex);
+
+		// First cell, or cell index has changed?
+		if (i == 0 || cellIndex != currentCellIndex)
+		{
+			currentCellIndex = cellIndex;
+
+			// Point the cell to the indices.
+			cells[cellIndex] = indicesOffset;
+			dirtyCells.add(cellIndex);
+
+			// Store the offset in the indices texture where we want to write number of lights to.
+			indicesNumLightsOffset = indicesOffset;
+
+			// Initialize num lights to 0.
+			indices[indicesNumLightsOffset] = 0;
+			indicesOffset++;
+		}
+
+		// Increment num lights.
+		indices[indicesNumLightsOffset]++;
+
+		// Write the light index.
+		indices[indicesOffset++] = lightIndex;
+	}
+
+	// Update the cells texture. The GPU copy still holds the cells from the last upload, so upload the rows covering both those and the new cells.
+	CellRange uploadCells = dirtyCells;
+
+	if (!texturesValid_)
+	{
+		uploadCells.first = 0;
+		uploadCells.last = cells.size();
+	}
+	else
+	{
+		uploadCells.add(uploadedCells_);
+	}
+
+	uploadedCells_ = dirtyCells;
+	texturesValid_ = true;
+
+	if (!uploadCells.isEmpty())
+	{
+		const uint16_t firstRow = uint16_t(uploadCells.first / cellsTextureSize_);
+		const uint16_t nRows = uint16_t((uploadCells.last - 1) / cellsTextureSize_ + 1 - firstRow);
+		const uint32_t size = uint32_t(nRows * cellsTextureSize_ * sizeof(uint32_t));
+		bgfx::updateTexture2D(cellsTexture_, 0, 0, 0, firstRow, cellsTextureSize_, nRows, bgfx::makeRef(&cells[firstRow * cellsTextureSize_], size));
+		uploadedBytes_ += size;
+	}
+
+	// Update the indices texture.
+	if (nLights_ > 0 && indicesOffset > 0)
+	{
+		assert(indicesOffset <= indices.size());
+		const uint16_t width = uint16_t(std::min(indicesOffset, (uint32_t)indicesTextureSize_));
+		const uint16_t height = uint16_t((indicesOffset + indicesTextureSize_ - 1) / indicesTextureSize_);
+
+		// Whole rows are uploaded, so the size has to cover the last row too.
+		const uint32_t size = uint32_t(width * height * sizeof(uint16_t));
+		bgfx::updateTexture2D(indicesTexture_, 0, 0, 0, 0, width, height, bgfx::makeRef(indices.data(), size));
+		uploadedBytes_ += size;
+	}
+
+	// Update the lights texture.
+	if (nLights_ > 0)
+	{
+		const uint32_t size = nLights_ * sizeof(DynamicLight);
+		const uint32_t texelSize = sizeof(float) * 4; // RGBA32F
+		const uint16_t nTexels = uint16_t(size / texelSize);
+		const uint16_t width = std::min(nTexels, lightsTextureSize_);
+		const uint16_t height = (uint16_t)std::ceil(nTexels / (float)lightsTextureSize_);
+		bgfx::updateTexture2D(lightsTexture_, 0, 0, 0, 0, width, height, bgfx::makeRef(lights_[buffer], size));
+		uploadedBytes_ += size;
+	}
+
+	printStats();
+}
+
+void DynamicLightManager::printStats() const
+{
+	if (g_cvars.debug.getInt() != 2)
+		return;
+
+	size_t nOccupiedCells = 0, maxCellLights = 0, cellLights = 0;
+
+	for (size_t i = 0; i < assignedLights_.size(); i++)
+	{
+		cellLights++;
+
+		if (i + 1 == assignedLights_.size() || (assignedLights_[i] >> 16) != (assignedLights_[i + 1] >> 16))
+		{
+			nOccupiedCells++;
+			maxCellLights = std::max(maxCellLights, cellLights);
+			cellLights = 0;
+		}
+	}
+
+	main::DebugPrint("dlights: %u assigned: %u", (uint32_t)nLights_, (uint32_t)assignedLights_.size());
+	main::DebugPrint("dlight cells: %u max lights: %u", (uint32_t)nOccupiedCells, (uint32_t)maxCellLights);
+	main::DebugPrint("dlight bytes uploaded: %u", uploadedBytes_);
+}
+
+void DynamicLightManager::assign(uint32_t buffer, vec3 cameraPosition, const mat3 &cameraRotation, vec2 fov, bool useClusters)
+{
+	clustersValid_ = useClusters;
+	assignParams_.buffer = buffer;
+	assignParams_.cameraPosition = cameraPosition;
+	assignParams_.cameraRotation = cameraRotation;
+
+	if (clustersValid_)
+	{
+		clusterFar_ = std::max(clusterNear_ * 2.0f, world::GetBounds().calculateFarthestCornerDistance(cameraPosition));
+		const float tanHalfFovX = tanf(DEG2RAD(fov.x) * 0.5f);
+		const float tanHalfFovY = tanf(DEG2RAD(fov.y) * 0.5f);
+
+		for (size_t i = 0; i < BX_COUNTOF(assignParams_.tileEdgesX); i++)
+			assignParams_.tileEdgesX[i] = (std::min(i, nClusterTilesX) / (float)nClusterTilesX * 2.0f - 1.0f) * tanHalfFovX;
+
+		for (size_t i = 0; i <= nClusterTilesY; i++)
+			assignParams_.tileEdgesY[i] = (i / (float)nClusterTilesY * 2.0f - 1.0f) * tanHalfFovY;
+	}
+
+	// Split the lights between this thread and the workers. Not worth waking them up for a handful of lights.
+	const size_t minLightsPerThread = 8;
+	const size_t nThreads = std::max(size_t(1), std::min(workers_.size() + 1, nLights_ / minLightsPerThread));
+	const size_t lightsPerThread = (nLights_ + nThreads - 1) / nThreads;
+
+	for (size_t i = 1; i < nThreads; i++)
+	{
+		AssignWorker *worker = workers_[i - 1].get();
+		worker->firstLight = uint16_t(std::min(i * lightsPerThread, (size_t)nLights_));
+		worker->lastLight = uint16_t(std::min((i + 1) * lightsPerThread, (size_t)nLights_));
+		SDL_SemPost(worker->start);
+	}
+
 	assignedLights_.clear();
+	assignLights(0, uint16_t(std::min(lightsPerThread, (size_t)nLights_)), &assignedLights_);
+
+	for (size_t i = 1; i < nThreads; i++)
+	{
+		SDL_SemWait(workersDone_);
+	}
+
+	for (size_t i = 1; i < nThreads; i++)
+	{
+		const std::vector<uint32_t> &workerLights = workers_[i - 1]->assignedLights;
+		assignedLights_.insert(assignedLights_.end(), workerLights.begin(), workerLights.end());
+	}
+
+	// Sort the assigned lights by cell, then light.
+	assignedLightsTemp_.resize(assignedLights_.size());
+	bx::radixSort(assignedLights_.data(), assignedLightsTemp_.data(), (uint32_t)assignedLights_.size());
+}
+
+void DynamicLightManager::benchmark(uint32_t frameNo)
+{
+	const uint32_t buffer = frameNo % BGFX_NUM_BUFFER_FRAMES;
+	const Bounds &bounds = world::GetBounds();
+	const vec3 cameraPosition = bounds.midpoint();
+	const mat3 cameraRotation;
+	const vec2 fov(90, 73.74f);
+	const int nIterations = 20;
+	std::minstd_rand generator(1);
+
+	for (size_t nBenchmarkLights : { (size_t)64, (size_t)256, (size_t)1024, maxLights })
+	{
+		// Random lights inside the world bounds. Every fourth light is a capsule, like rail and lightning beams.
+		clear();
+
+		for (size_t i = 0; i < nBenchmarkLights; i++)
+		{
+			DynamicLight light;
+
+			for (size_t j = 0; j < 3; j++)
+			{
+				light.position_type[j] = math::RandomFloat(generator, bounds.min[j], bounds.max[j]);
+				light.capsuleEnd[j] = light.position_type[j] + math::RandomFloat(generator, -256, 256);
+			}
+
+			light.position_type.w = i % 4 == 0 ? DynamicLight::Capsule : DynamicLight::Point;
+			light.color_radius = vec4(1, 1, 1, math::RandomFloat(generator, 100, 300));
+			add(frameNo, light);
+		}
+
+		for (bool useClusters : { false, true })
+		{
+			const int64_t start = bx::getHPCounter();
+
+			for (int i = 0; i < nIterations; i++)
+			{
+				assign(buffer, cameraPosition, cameraRotation, fov, useClusters);
+			}
+
+			const double elapsed = (bx::getHPCounter() - start) / (double)bx::getHPFrequency();
+			interface::Printf("%4u lights, %s: %0.3fms per update, %u assigned\n", (uint32_t)nBenchmarkLights, useClusters ? "grid and clusters" : "grid", elapsed * 1000.0 / nIterations, (uint32_t)assignedLights_.size());
+		}
+	}
+
+	// The benchmark clobbered the assigned lights, so force a full rebuild next frame.
+	clear();
+	texturesValid_ = false;
+}
+
+int DynamicLightManager::AssignWorkerThread(void *data)
+{
+	auto worker = (AssignWorker *)data;
+
+	for (;;)
+	{
+		SDL_SemWait(worker->start);
+
+		if (SDL_AtomicGet(&worker->manager->workersQuit_))
+			break;
+
+		worker->assignedLights.clear();
+		worker->manager->assignLights(worker->firstLight, worker->lastLight, &worker->assignedLights);
+		SDL_SemPost(worker->manager->workersDone_);
+	}
+
+	return 0;
+}
+
+/// @brief Convert a SIMD comparison result to a 4 bit lane mask.
+static uint32_t LaneMask(bx::simd128_t compare)
+{
+	BX_ALIGN_DECL_16(uint32_t) lanes[4];
+	bx::simd_st(lanes, compare);
+	return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+}
+
+/// @brief Test four points against a capsule. A capsule with the same start and end is a sphere.
+/// @return Lane mask of the points within radius of the capsule segment.
+static uint32_t CapsuleContainsPoints4(vec3 start, vec3 end, float radius, bx::simd128_t x, bx::simd128_t y, bx::simd128_t z)
+{
+	const vec3 ab = end - start;
+	const float invLengthSquared = 1.0f / std::max(vec3::dotProduct(ab, ab), 0.001f);
+	const bx::simd128_t abX = bx::simd_splat(ab.x), abY = bx::simd_splat(ab.y), abZ = bx::simd_splat(ab.z);
+	const bx::simd128_t apX = bx::simd_sub(x, bx::simd_splat(start.x));
+	const bx::simd128_t apY = bx::simd_sub(y, bx::simd_splat(start.y));
+	const bx::simd128_t apZ = bx::simd_sub(z, bx::simd_splat(start.z));
+
+	// The closest point on the segment is start + ab * t.
+	bx::simd128_t t = bx::simd_madd(apX, abX, bx::simd_madd(apY, abY, bx::simd_mul(apZ, abZ)));
+	t = bx::simd_clamp(bx::simd_mul(t, bx::simd_splat(invLengthSquared)), bx::simd_zero(), bx::simd_splat(1.0f));
+	const bx::simd128_t dX = bx::simd_nmsub(abX, t, apX);
+	const bx::simd128_t dY = bx::simd_nmsub(abY, t, apY);
+	const bx::simd128_t dZ = bx::simd_nmsub(abZ, t, apZ);
+	const bx::simd128_t distanceSquared = bx::simd_madd(dX, dX, bx::simd_madd(dY, dY, bx::simd_mul(dZ, dZ)));
+	return LaneMask(bx::simd_cmple(distanceSquared, bx::simd_splat(radius * radius)));
+}
+
+/// @brief Test a sphere against four AABBs.
+/// @return Lane mask of the boxes the sphere touches.
+static uint32_t SphereIntersectsBoxes4(vec3 center, float radius, bx::simd128_t minX, bx::simd128_t maxX, bx::simd128_t minY, bx::simd128_t maxY, bx::simd128_t minZ, bx::simd128_t maxZ)
+{
+	const bx::simd128_t cX = bx::simd_splat(center.x), cY = bx::simd_splat(center.y), cZ = bx::simd_splat(center.z);
+	const bx::simd128_t dX = bx::simd_sub(bx::simd_clamp(cX, minX, maxX), cX);
+	const bx::simd128_t dY = bx::simd_sub(bx::simd_clamp(cY, minY, maxY), cY);
+	const bx::simd128_t dZ = bx::simd_sub(bx::simd_clamp(cZ, minZ, maxZ), cZ);
+	const bx::simd128_t distanceSquared = bx::simd_madd(dX, dX, bx::simd_madd(dY, dY, bx::simd_mul(dZ, dZ)));
+	return LaneMask(bx::simd_cmple(distanceSquared, bx::simd_splat(radius * radius)));
+}
+
+void DynamicLightManager::assignLights(uint16_t firstLight, uint16_t lastLight, std::vector<uint32_t> *assignedLights) const
+{
+	assert(assignedLights);
+	assignLightsToGrid(firstLight, lastLight, assignedLights);
+
+	if (clustersValid_)
+	{
+		assignLightsToClusters(firstLight, lastLight, assignedLights);
+	}
+}
+
+void DynamicLightManager::assignLightsToGrid(uint16_t firstLight, uint16_t lastLight, std::vector<uint32_t> *assignedLights) const
+{
 	const float cellRadius = vec3::distance(vec3::empty, vec3((float)cellSize_.x, (float)cellSize_.y, (float)cellSize_.z)) / 2.0f;
 
-	for (uint8_t i = 0; i < nLights_; i++)
+	for (uint16_t i = firstLight; i < lastLight; i++)
 	{
-		const DynamicLight &dl = lights_[buffer][i];
+		const DynamicLight &dl = lights_[assignParams_.buffer][i];
 		vec3b min(gridSize_.x, gridSize_.y, gridSize_.z);
 		vec3b max;
 
@@ -176,134 +553,189 @@ void DynamicLightManager::updateTextures(uint32_t frameNo)
 			}
 		}
 
+		// Finer grained culling.
+		// Check cell centers against the light radius, four cells along z at a time.
+		// Point lights are capsules with the same start and end.
+		const vec3 start = dl.position_type.xyz();
+		const vec3 end = dl.position_type.w == DynamicLight::Capsule ? dl.capsuleEnd.xyz() : start;
+		const float halfCellZ = cellSize_.z / 2.0f;
+
 		for (uint8_t x = min.x; x <= max.x; x++)
 		{
+			const bx::simd128_t cellCenterX = bx::simd_splat(-gridOffset_.x + x * cellSize_.x + cellSize_.x / 2.0f);
+
 			for (uint8_t y = min.y; y <= max.y; y++)
 			{
-				for (uint8_t z = min.z; z <= max.z; z++)
+				const bx::simd128_t cellCenterY = bx::simd_splat(-gridOffset_.y + y * cellSize_.y + cellSize_.y / 2.0f);
+
+				for (int z = min.z; z <= max.z; z += 4)
 				{
-					// Finer grained culling.
-					// Check cells against light radius for point lights.
-					// Capsule lights use radius from the closest point on the capsule light segment.
-					vec3 cellCenter;
-					cellCenter.x = -gridOffset_.x + x * cellSize_.x + cellSize_.x / 2.0f;
-					cellCenter.y = -gridOffset_.y + y * cellSize_.y + cellSize_.y / 2.0f;
-					cellCenter.z = -gridOffset_.z + z * cellSize_.z + cellSize_.z / 2.0f;
-					vec3 comparePosition;
-
-					if (dl.position_type.w == DynamicLight::Point)
-					{
-						comparePosition = dl.position_type.xyz();
-					}
-					else if (dl.position_type.w == DynamicLight::Capsule)
-					{
-						comparePosition = math::ClosestPointOnLineSegment(dl.position_type.xyz(), dl.capsuleEnd.xyz(), cellCenter);
-					}
+					const float firstCenterZ = -gridOffset_.z + z * cellSize_.z + halfCellZ;
+					const bx::simd128_t cellCenterZ = bx::simd_ld(firstCenterZ, firstCenterZ + cellSize_.z, firstCenterZ + cellSize_.z * 2.0f, firstCenterZ + cellSize_.z * 3.0f);
+					uint32_t mask = CapsuleContainsPoints4(start, end, cellRadius + dl.color_radius.w, cellCenterX, cellCenterY, cellCenterZ);
 
-					if (vec3::distance(cellCenter, comparePosition) > cellRadius + dl.color_radius.w)
-						continue;
+					// Ignore lanes past the end of the range.
+					mask &= (1 << std::min(4, max.z - z + 1)) - 1;
 
-					assignedLights_.push_back(encodeAssignedLight(vec3b(x, y, z), i));
+					for (int lane = 0; lane < 4; lane++)
+					{
+						if (mask & (1 << lane))
+							assignedLights->push_back(encodeAssignedLight(cellIndexFromCellPosition(vec3b(x, y, uint8_t(z + lane))), i));
+					}
 				}
 			}
 		}
 	}
-	PROFILE_END // AssignLights
-
-	// Sort the assigned lights.
-	std::sort(assignedLights_.begin(), assignedLights_.end());
+}
 
-	// Fill cells and indices texture data.
-	// Make sure the first index uses num 0, so all empty cells can use it.
-	memset(cellsTextureData_[buffer].data(), 0, cellsTextureData_[buffer].size() * sizeof(uint16_t));
-	uint16_t indicesOffset = 0;
-	indicesTextureData_[buffer][indicesOffset++] = 0; // Empty cells will point here.
-	size_t currentCellIndex = 0;
-	uint16_t indicesNumLightsOffset = 0;
+void DynamicLightManager::assignLightsToClusters(uint16_t firstLight, uint16_t lastLight, std::vector<uint32_t> *assignedLights) const
+{
+	const vec3 cameraPosition = assignParams_.cameraPosition;
+	const mat3 &cameraRotation = assignParams_.cameraRotation;
+	const float tanHalfFovX = assignParams_.tileEdgesX[nClusterTilesX];
+	const float tanHalfFovY = assignParams_.tileEdgesY[nClusterTilesY];
 
-	for (size_t i = 0; i < assignedLights_.size(); i++)
+	for (uint16_t i = firstLight; i < lastLight; i++)
 	{
-		vec3b cellPosition;
-		uint8_t lightIndex;
-		decodeAssignedLight(assignedLights_[i], &cellPosition, &lightIndex);
-		const size_t cellIndex = cellIndexFromCellPosition(cellPosition);
+		const DynamicLight &dl = lights_[assignParams_.buffer][i];
+		// Use a bounding sphere for capsules.
+		vec3 center = dl.position_type.xyz();
+		float radius = dl.color_radius.w;
 
-		// First cell, or cell index has changed?
-		if (i == 0 || cellIndex != currentCellIndex)
+		if (dl.position_type.w == DynamicLight::Capsule)
 		{
-			currentCellIndex = cellIndex;
+			center = (dl.position_type.xyz() + dl.capsuleEnd.xyz()) * 0.5f;
+			radius += vec3::distance(dl.position_type.xyz(), dl.capsuleEnd.xyz()) * 0.5f;
+		}
 
-			// Point the cell to the indices.
-			cellsTextureData_[buffer][cellIndex] = indicesOffset;
+		// View space, x right, y up, z forward.
+		const vec3 d = center - cameraPosition;
+		const vec3 v(-vec3::dotProduct(d, cameraRotation[1]), vec3::dotProduct(d, cameraRotation[2]), vec3::dotProduct(d, cameraRotation[0]));
 
-			// Store the offset in the indices texture where we want to write number of lights to.
-			indicesNumLightsOffset = indicesOffset;
+		if (v.z + radius <= 0)
+			continue; // Behind the camera.
 
-			// Initialize num lights to 0.
-			indicesTextureData_[buffer][indicesNumLightsOffset] = 0;
-			indicesOffset++;
+		// Coarse culling.
+		// The sphere's view space AABB gives the range of slices and screen tiles it touches. x / z is monotonic, so the extremes are at the corners.
+		const float zMin = std::max(v.z - radius, 1.0f);
+		const float zMax = v.z + radius;
+		vec2 ndcMin(FLT_MAX, FLT_MAX), ndcMax(-FLT_MAX, -FLT_MAX);
+
+		for (float z : { zMin, zMax })
+		{
+			for (float sign : { -1.0f, 1.0f })
+			{
+				const float x = (v.x + radius * sign) / (z * tanHalfFovX);
+				const float y = (v.y + radius * sign) / (z * tanHalfFovY);
+				ndcMin.x = std::min(ndcMin.x, x);
+				ndcMin.y = std::min(ndcMin.y, y);
+				ndcMax.x = std::max(ndcMax.x, x);
+				ndcMax.y = std::max(ndcMax.y, y);
+			}
 		}
 
-		// Increment num lights.
-		indicesTextureData_[buffer][indicesNumLightsOffset]++;
+		if (ndcMin.x > 1 || ndcMin.y > 1 || ndcMax.x < -1 || ndcMax.y < -1)
+			continue; // Outside the view frustum.
 
-		// Write the light index.
-		indicesTextureData_[buffer][indicesOffset++] = lightIndex;
+		auto tileFromNdc = [](float ndc, size_t nTiles)
+		{
+			return (size_t)math::Clamped((ndc * 0.5f + 0.5f) * nTiles, 0.0f, nTiles - 1.0f);
+		};
+
+		const size_t minX = tileFromNdc(ndcMin.x, nClusterTilesX), maxX = tileFromNdc(ndcMax.x, nClusterTilesX);
+		const size_t minY = tileFromNdc(ndcMin.y, nClusterTilesY), maxY = tileFromNdc(ndcMax.y, nClusterTilesY);
+		const size_t minZ = clusterSliceFromDepth(zMin), maxZ = clusterSliceFromDepth(zMax);
 
-		if (indicesOffset > uint16_t(UINT16_MAX - 2))
+		for (size_t z = minZ; z <= maxZ; z++)
 		{
-			interface::PrintWarningf("Too many assigned lights.\n");
-			break;
+			const float sliceNear = clusterSliceNearDepth(z);
+			const float sliceFar = z + 1 == nClusterSlices ? FLT_MAX : clusterSliceNearDepth(z + 1);
+			const float farDepth = std::min(sliceFar, zMax);
+			const bx::simd128_t nearDepth4 = bx::simd_splat(sliceNear), farDepth4 = bx::simd_splat(farDepth);
+
+			for (size_t y = minY; y <= maxY; y++)
+			{
+				// Finer grained culling.
+				// Check the view space AABBs of four clusters along x at a time against the light sphere.
+				const bx::simd128_t tileBottom = bx::simd_splat(assignParams_.tileEdgesY[y]);
+				const bx::simd128_t tileTop = bx::simd_splat(assignParams_.tileEdgesY[y + 1]);
+				const bx::simd128_t boundsMinY = bx::simd_min(bx::simd_mul(tileBottom, nearDepth4), bx::simd_mul(tileBottom, farDepth4));
+				const bx::simd128_t boundsMaxY = bx::simd_max(bx::simd_mul(tileTop, nearDepth4), bx::simd_mul(tileTop, farDepth4));
+
+				for (size_t x = minX; x <= maxX; x += 4)
+				{
+					// tileEdgesX is padded, so reading past the last tile is safe.
+					const float *edges = &assignParams_.tileEdgesX[x];
+					const bx::simd128_t tileLeft = bx::simd_ld(edges[0], edges[1], edges[2], edges[3]);
+					const bx::simd128_t tileRight = bx::simd_ld(edges[1], edges[2], edges[3], edges[4]);
+					const bx::simd128_t boundsMinX = bx::simd_min(bx::simd_mul(tileLeft, nearDepth4), bx::simd_mul(tileLeft, farDepth4));
+					const bx::simd128_t boundsMaxX = bx::simd_max(bx::simd_mul(tileRight, nearDepth4), bx::simd_mul(tileRight, farDepth4));
+					uint32_t mask = SphereIntersectsBoxes4(v, radius, boundsMinX, boundsMaxX, boundsMinY, boundsMaxY, nearDepth4, farDepth4);
+
+					// Ignore lanes past the end of the range.
+					mask &= (1 << std::min(size_t(4), maxX - x + 1)) - 1;
+
+					for (size_t lane = 0; lane < 4; lane++)
+					{
+						if (mask & (1 << lane))
+						{
+							const size_t clusterIndex = x + lane + y * nClusterTilesX + z * nClusterTilesX * nClusterTilesY;
+							assignedLights->push_back(encodeAssignedLight(nGridCells_ + clusterIndex, i));
+						}
+					}
+				}
+			}
 		}
 	}
+}
 
-	// Update the cells texture.
-	bgfx::updateTexture2D(cellsTexture_, 0, 0, 0, 0, cellsTextureSize_, cellsTextureSize_, bgfx::makeRef(cellsTextureData_[buffer].data(), uint32_t(cellsTextureData_[buffer].size() * sizeof(uint16_t))));
+size_t DynamicLightManager::clusterSliceFromDepth(float depth) const
+{
+	if (depth <= clusterNear_)
+		return 0;
 
-	// Update the indices texture.
-	if (nLights_ > 0 && indicesOffset > 0)
-	{
-		assert(indicesOffset < indicesTextureSize_ * indicesTextureSize_);
-		const uint16_t width = std::min(indicesOffset, indicesTextureSize_);
-		const uint16_t height = (uint16_t)std::ceil(indicesOffset / (float)indicesTextureSize_);
-		bgfx::updateTexture2D(indicesTexture_, 0, 0, 0, 0, width, height, bgfx::makeRef(indicesTextureData_[buffer].data(), indicesOffset));
-	}
+	const float slice = logf(depth / clusterNear_) * nClusterSlices / logf(clusterFar_ / clusterNear_);
+	return (size_t)math::Clamped(slice, 0.0f, nClusterSlices - 1.0f);
+}
 
-	// Update the lights texture.
-	if (nLights_ > 0)
-	{
-		const uint32_t size = nLights_ * sizeof(DynamicLight);
-		const uint32_t texelSize = sizeof(float) * 4; // RGBA32F
-		const uint16_t nTexels = uint16_t(size / texelSize);
-		const uint16_t width = std::min(nTexels, lightsTextureSize_);
-		const uint16_t height = (uint16_t)std::ceil(nTexels / (float)lightsTextureSize_);
-		bgfx::updateTexture2D(lightsTexture_, 0, 0, 0, 0, width, height, bgfx::makeRef(lights_[buffer], size));
-	}
+float DynamicLightManager::clusterSliceNearDepth(size_t slice) const
+{
+	if (slice == 0)
+		return 0;
+
+	return clusterNear_ * powf(clusterFar_ / clusterNear_, slice / (float)nClusterSlices);
 }
 
-void DynamicLightManager::updateUniforms(Uniforms *uniforms)
+void DynamicLightManager::updateUniforms(Uniforms *uniforms, bool useClusters)
 {
 	assert(uniforms);
+	useClusters = useClusters && clustersValid_;
 	uniforms->dynamicLightCellSize.set(vec4((float)cellSize_.x, (float)cellSize_.y, (float)cellSize_.z, (float)cellsTextureSize_));
 	uniforms->dynamicLightGridOffset.set(gridOffset_);
-	uniforms->dynamicLightGridSize.set(vec4((float)gridSize_.x, (float)gridSize_.y, (float)gridSize_.z, 0));
+	uniforms->dynamicLightGridSize.set(vec4((float)gridSize_.x, (float)gridSize_.y, (float)gridSize_.z, useClusters ? 1.0f : 0.0f));
+
+	if (useClusters)
+	{
+		uniforms->dynamicLightClusterSize.set(vec4((float)nClusterTilesX, (float)nClusterTilesY, (float)nClusterSlices, (float)nGridCells_));
+		uniforms->dynamicLightClusterDepth.set(vec4(clusterNear_, nClusterSlices / logf(clusterFar_ / clusterNear_), 0, 0));
+	}
+
 	uniforms->dynamicLight_Num_Intensity.set(vec4((float)nLights_, g_cvars.dynamicLightIntensity.getFloat(), 0, 0));
 	uniforms->dynamicLightTextureSizes_Cells_Indices_Lights.set(vec4((float)cellsTextureSize_, (float)indicesTextureSize_, (float)lightsTextureSize_, 0));
 }
 
-void DynamicLightManager::decodeAssignedLight(uint32_t value, vec3b *cellPosition, uint8_t *lightIndex) const
+void DynamicLightManager::decodeAssignedLight(uint32_t value, size_t *cellIndex, uint16_t *lightIndex) const
 {
-	assert(cellPosition);
+	assert(cellIndex);
 	assert(lightIndex);
-	cellPosition->x = (value >> 24) & 0xff;
-	cellPosition->y = (value >> 16) & 0xff;
-	cellPosition->z = (value >> 8) & 0xff;
-	*lightIndex = value & 0xff;
+	*cellIndex = value >> 16;
+	*lightIndex = value & 0xffff;
 }
 
-uint32_t DynamicLightManager::encodeAssignedLight(vec3b cellPosition, uint8_t lightIndex) const
+uint32_t DynamicLightManager::encodeAssignedLight(size_t cellIndex, uint16_t lightIndex) const
 {
-	return (cellPosition.x << 24) + (cellPosition.y << 16) + (cellPosition.z << 8) + lightIndex;
+	assert(cellIndex < (1 << 16));
+	return uint32_t(cellIndex << 16) + lightIndex;
 }
 
 size_t DynamicLightManager::cellIndexFromCellPosition(vec3b position) const
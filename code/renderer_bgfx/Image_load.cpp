@@ -102,7 +102,7 @@ static void ReleaseImageData(void *data, void *userData)
 	free(data);
 }
 
-static void FinalizeImage(Image *image, int flags)
+void FinalizeImage(Image *image, int flags)
 {
 	assert(image);
 
@@ -160,6 +160,38 @@ static void FinalizeImage(Image *image, int flags)
 	}
 }
 
+Image CreateLowMipImage(const Image &image, int flags, int maxSize)
+{
+	assert(image.data);
+	assert(image.nMips == 1);
+
+	// Start from the dimensions the full image will have after picmip.
+	int width = image.width, height = image.height;
+
+	if ((flags & CreateImageFlags::Picmip) && g_cvars.picmip.getInt() > 0)
+	{
+		width = std::max(1, width >> g_cvars.picmip.getInt());
+		height = std::max(1, height >> g_cvars.picmip.getInt());
+	}
+
+	// Skip mips until the image fits.
+	while (width > maxSize || height > maxSize)
+	{
+		width = std::max(1, width >> 1);
+		height = std::max(1, height >> 1);
+	}
+
+	Image lowMip;
+	lowMip.width = width;
+	lowMip.height = height;
+	lowMip.nComponents = image.nComponents;
+	lowMip.data = (uint8_t *)malloc(width * height * image.nComponents);
+	lowMip.release = ReleaseImageData;
+	stbir_resize_uint8(image.data, image.width, image.height, 0, lowMip.data, width, height, 0, image.nComponents);
+	FinalizeImage(&lowMip, CreateImageFlags::GenerateMipmaps);
+	return lowMip;
+}
+
 Image CreateImage(int width, int height, int nComponents, uint8_t *data, int flags)
 {
 	Image image;
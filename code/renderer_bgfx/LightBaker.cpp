@@ -215,7 +215,7 @@ static int Thread(void *data)
 
 			if (IsSurfaceLightmapped(surface))
 			{
-				s_lightBaker->totalLightmappedTriangles += int(surface.indices.size() / 3);
+				s_lightBaker->totalLightmappedTriangles += int(surface.nIndices / 3);
 			}
 		}
 	}
@@ -285,6 +285,12 @@ void Start(int nSamples)
 	if (s_lightBaker.get() || !world::IsLoaded())
 		return;
 
+	if (world::IsGeometryCompact())
+	{
+		interface::PrintWarningf("The light baker needs the world vertices, which were freed by r_compactWorldGeometry. Set it to 0 and restart the renderer.\n");
+		return;
+	}
+
 	s_lightBaker = std::make_unique<LightBaker>();
 	s_lightBakerPersistent = std::make_unique<LightBakerPersistent>();
 
@@ -219,14 +219,16 @@ static bool CreateEmbreeGeometry(int nVertices, int nTriangles)
 		for (int i = 0; i < (int)surface.bufferIndex; i++)
 			indexOffset += (uint32_t)world::GetVertexBuffer(i).size();
 
-		for (size_t i = 0; i < surface.indices.size(); i += 3)
+		const uint32_t *indices = surface.getIndices();
+
+		for (size_t i = 0; i < surface.nIndices; i += 3)
 		{
 			if (surface.material->isSky || (surface.flags & SURF_SKY))
 				s_lightBaker->faceFlags[faceIndex] |= FaceFlags::Sky;
 
-			triangles[faceIndex].indices[0] = indexOffset + surface.indices[i + 0];
-			triangles[faceIndex].indices[1] = indexOffset + surface.indices[i + 1];
-			triangles[faceIndex].indices[2] = indexOffset + surface.indices[i + 2];
+			triangles[faceIndex].indices[0] = indexOffset + indices[i + 0];
+			triangles[faceIndex].indices[1] = indexOffset + indices[i + 1];
+			triangles[faceIndex].indices[2] = indexOffset + indices[i + 2];
 			faceIndex++;
 		}
 	}
@@ -277,15 +279,25 @@ static void CalculateLightEnvelope(StaticLight *light)
 
 static void CreateEntityLights()
 {
+	const int ambientKey = world::FindEntityKey("ambient");
+	const int classnameKey = world::FindEntityKey("classname");
+	const int colorKey = world::FindEntityKey("_color");
+	const int lightKey = world::FindEntityKey("light");
+	const int originKey = world::FindEntityKey("origin");
+	const int radiusKey = world::FindEntityKey("radius");
+	const int spawnFlagsKey = world::FindEntityKey("spawnflags");
+	const int targetKey = world::FindEntityKey("target");
+	const int targetNameKey = world::FindEntityKey("targetname");
+
 	for (size_t i = 0; i < world::s_world->entities.size(); i++)
 	{
 		const world::Entity &entity = world::s_world->entities[i];
-		const char *classname = entity.findValue("classname", "");
+		const char *classname = entity.findValue(classnameKey, "");
 
 		if (!util::Stricmp(classname, "worldspawn"))
 		{
-			const char *color = entity.findValue("_color");
-			const char *ambient = entity.findValue("ambient");
+			const char *color = entity.findValue(colorKey);
+			const char *ambient = entity.findValue(ambientKey);
 					
 			if (color && ambient)
 				s_lightBaker->ambientLight = ParseColorString(color) * (float)atof(ambient);
@@ -296,7 +308,7 @@ static void CreateEntityLights()
 			continue;
 
 		StaticLight light;
-		const char *color = entity.findValue("_color");
+		const char *color = entity.findValue(colorKey);
 					
 		if (color)
 		{
@@ -307,16 +319,16 @@ static void CreateEntityLights()
 			light.color = vec4::white;
 		}
 
-		light.intensity = (float)atof(entity.findValue("light", "300"));
+		light.intensity = (float)atof(entity.findValue(lightKey, "300"));
 		light.photons = light.intensity * s_lightBaker->pointScale;
-		const char *origin = entity.findValue("origin");
+		const char *origin = entity.findValue(originKey);
 
 		if (!origin)
 			continue;
 
 		sscanf(origin, "%f %f %f", &light.position.x, &light.position.y, &light.position.z);
-		light.radius = (float)atof(entity.findValue("radius", "64"));
-		const int spawnFlags = atoi(entity.findValue("spawnflags", "0"));
+		light.radius = (float)atof(entity.findValue(radiusKey, "64"));
+		const int spawnFlags = atoi(entity.findValue(spawnFlagsKey, "0"));
 		light.flags = StaticLightFlags::DefaultMask;
 
 		// From q3map2 CreateEntityLights.
@@ -334,7 +346,7 @@ static void CreateEntityLights()
 		}
 
 		// Find target (spotlights).
-		const char *target = entity.findValue("target");
+		const char *target = entity.findValue(targetKey);
 
 		if (target)
 		{
@@ -345,11 +357,11 @@ static void CreateEntityLights()
 			for (size_t j = 0; j < world::s_world->entities.size(); j++)
 			{
 				const world::Entity &targetEntity = world::s_world->entities[j];
-				const char *targetName = targetEntity.findValue("targetname");
+				const char *targetName = targetEntity.findValue(targetNameKey);
 
 				if (targetName && !util::Stricmp(targetName, target))
 				{
-					const char *origin = targetEntity.findValue("origin");
+					const char *origin = targetEntity.findValue(originKey);
 
 					if (!origin)
 						continue;
@@ -628,14 +640,15 @@ static void CreateAreaLights()
 			light.surfaceIndex = si;
 			light.texture = texture;
 			const std::vector<Vertex> &vertices = world::GetVertexBuffer((int)surface.bufferIndex);
+			const uint32_t *indices = surface.getIndices();
 
 			// Create one sample per triangle at the midpoint.
-			for (size_t i = 0; i < surface.indices.size(); i += 3)
+			for (size_t i = 0; i < surface.nIndices; i += 3)
 			{
 				const Vertex *v[3];
-				v[0] = &vertices[surface.indices[i + 0]];
-				v[1] = &vertices[surface.indices[i + 1]];
-				v[2] = &vertices[surface.indices[i + 2]];
+				v[0] = &vertices[indices[i + 0]];
+				v[1] = &vertices[indices[i + 1]];
+				v[2] = &vertices[indices[i + 2]];
 
 				// From q3map2 RadSubdivideDiffuseLight
 				const float area = vec3::crossProduct(v[1]->pos - v[0]->pos, v[2]->pos - v[0]->pos).length();
@@ -674,10 +687,8 @@ static void CreateAreaLights()
 		const uint8_t *worldPvs = &world::s_world->visData[i * world::s_world->clusterBytes];
 		uint8_t *areaLightPvs = &s_lightBaker->areaLightVisData[i * s_lightBaker->areaLightClusterBytes];
 
-		for (size_t j = world::s_world->firstLeaf; j < world::s_world->nodes.size(); j++)
+		for (const world::Leaf &leaf : world::s_world->leaves)
 		{
-			world::Node &leaf = world::s_world->nodes[j];
-
 			if (!(worldPvs[leaf.cluster >> 3] & (1 << (leaf.cluster & 7))))
 				continue;
 
@@ -764,7 +775,7 @@ static float PointToPolygonFormFactor(vec3 point, vec3 normal, const Winding &w)
 
 static vec3 BakeAreaLights(vec3 samplePosition, vec3 sampleNormal)
 {
-	world::Node *sampleLeaf = world::LeafFromPosition(samplePosition);
+	const world::Leaf *sampleLeaf = world::LeafFromPosition(samplePosition);
 	vec3 accumulatedLight;
 
 	for (size_t i = 0; i < s_areaLights.size(); i++)
@@ -842,7 +853,7 @@ bool InitializeDirectLight()
 
 			if (mi == 0 && DoesSurfaceOccludeLight(surface))
 			{
-				totalOccluderTriangles += (int)surface.indices.size() / 3;
+				totalOccluderTriangles += (int)surface.nIndices / 3;
 			}
 		}
 	}
@@ -499,7 +499,7 @@ static bool CurrentOrNextValidTriangle()
 		
 		const world::Surface &surface = world::GetSurface(s_rasterizer.modelIndex, s_rasterizer.surfaceIndex);
 
-		if (!IsSurfaceLightmapped(surface) || s_rasterizer.triangleIndex >= surface.indices.size() / 3)
+		if (!IsSurfaceLightmapped(surface) || s_rasterizer.triangleIndex >= surface.nIndices / 3)
 		{
 			// Surface is invalid, or we're finished with the surface's triangles. Move to the next surface.
 			s_rasterizer.triangleIndex = 0;
@@ -582,7 +582,7 @@ Luxel RasterizeLuxel()
 
 			for (int i = 0; i < 3; i++)
 			{
-				const Vertex &v = vertices[surface.indices[s_rasterizer.triangleIndex * 3 + i]];
+				const Vertex &v = vertices[surface.getIndices()[s_rasterizer.triangleIndex * 3 + i]];
 				ctx.triangle.p[i].x = v.pos.x;
 				ctx.triangle.p[i].y = v.pos.y;
 				ctx.triangle.p[i].z = v.pos.z;
@@ -30,6 +30,36 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 namespace renderer {
 
 bgfx::VertexDecl Vertex::decl;
+bgfx::VertexDecl CompactVertex::decl;
+
+static int16_t PackSnorm16(float value)
+{
+	return int16_t(math::Clamped(value, -1.0f, 1.0f) * INT16_MAX);
+}
+
+const bgfx::Memory *CompactVertex::copy(const Vertex *vertices, uint32_t nVertices)
+{
+	assert(vertices);
+	const bgfx::Memory *mem = bgfx::alloc(sizeof(CompactVertex) * nVertices);
+	auto dest = (CompactVertex *)mem->data;
+
+	for (uint32_t i = 0; i < nVertices; i++)
+	{
+		const Vertex &src = vertices[i];
+		CompactVertex &cv = dest[i];
+		cv.pos = src.pos;
+		cv.normal[0] = PackSnorm16(src.normal.x);
+		cv.normal[1] = PackSnorm16(src.normal.y);
+		cv.normal[2] = PackSnorm16(src.normal.z);
+		cv.normal[3] = 0;
+		cv.color = src.color;
+		cv.texCoord = vec2(src.texCoord.x, src.texCoord.y);
+		cv.lightmapTexCoord[0] = PackSnorm16(src.texCoord.z);
+		cv.lightmapTexCoord[1] = PackSnorm16(src.texCoord.w);
+	}
+
+	return mem;
+}
 
 int g_overBrightBits;
 float g_overbrightFactor;
@@ -376,6 +406,11 @@ const SunLight &GetSunLight()
 	return s_main->sunLight;
 }
 
+void InvalidateStaticShadows()
+{
+	s_main->staticShadowMapValid = false;
+}
+
 bool IsCameraMirrored()
 {
 	return s_main->isCameraMirrored;
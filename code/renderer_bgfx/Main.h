@@ -99,6 +99,17 @@ struct GenericShaderProgramVariant
 	};
 };
 
+/// @remarks Bloom is applied in the same pass as SMAA neighborhood blending.
+struct SMAANeighborhoodBlendingShaderProgramVariant
+{
+	enum
+	{
+		None  = 0,
+		Bloom = 1 << 0,
+		Num   = 1 << 1
+	};
+};
+
 struct TextureVariationShaderProgramVariant
 {
 	enum
@@ -124,6 +135,7 @@ struct ShaderProgramId
 		SMAABlendingWeightCalculation,
 		SMAAEdgeDetection,
 		SMAANeighborhoodBlending,
+		Skybox = SMAANeighborhoodBlending + SMAANeighborhoodBlendingShaderProgramVariant::Num,
 		Texture,
 		TextureColor,
 		TextureDebug,
@@ -144,6 +156,19 @@ struct Main
 	/// Does the current camera render the world - i.e. not part of a HUD/UI scene.
 	bool isWorldCamera = false;
 
+	/// @brief Fog uniform values calculated by world::CalculateFog.
+	/// @remarks Cached per fog and entity, since they only change with the camera and the entity model matrix.
+	struct CameraFog
+	{
+		int fogIndex = -1;
+		const Entity *entity = nullptr;
+		vec4 color, distance, depth;
+		float eyeT = 0;
+	};
+
+	/// @remarks Cleared when the current camera starts submitting draw calls.
+	std::vector<CameraFog> cameraFogs;
+
 	/// @}
 
 	/// @name Fonts
@@ -175,9 +200,12 @@ struct Main
 	FrameBuffer depthFb;
 	FrameBuffer reflectionFb;
 	FrameBuffer sceneFb;
-	FrameBuffer sceneTempFb;
 	uint8_t sceneBloomAttachment;
 	uint8_t sceneDepthAttachment;
+
+	/// @brief Soft sprites read a copy of the sceneFb depth attachment, made after opaque geometry is rendered, instead of depth from a separate pre-pass.
+	/// @remarks Requires texture blit support. Not possible with MSAA, since the scene depth attachment would need resolving.
+	bool softSpriteDepthCopyEnabled = false;
 	static const size_t nBloomFrameBuffers = 2;
 	FrameBuffer bloomFb[nBloomFrameBuffers];
 	/// @}
@@ -228,7 +256,19 @@ struct Main
 	/// @name Shadows
 	/// @{
 	FrameBuffer shadowMapFb;
-	static const int shadowMapSize = 4096;
+	int shadowMapSize;
+
+	/// 0 if the shadow map covers the whole world.
+	int nShadowCascades;
+
+	/// @brief Depth of the static world geometry from the sun's point of view.
+	/// @remarks Copied into shadowMapFb every frame before dynamic geometry is rendered. Invalid handle if texture blit isn't supported.
+	FrameBuffer staticShadowMapFb;
+
+	bool staticShadowMapValid = false;
+	vec3 staticShadowMapSunDirection;
+	Bounds staticShadowMapWorldBounds;
+	DrawCallList shadowDrawCalls;
 	/// @}
 
 	/// @name Skybox portals
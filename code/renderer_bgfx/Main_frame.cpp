@@ -99,6 +99,7 @@ static void FlushStretchPics()
 			s_main->floatTime = s_main->time * 0.001f;
 			s_main->uniforms->renderMode.set(vec4::empty);
 			s_main->uniforms->dynamicLight_Num_Intensity.set(vec4::empty);
+			s_main->uniforms->fogEnabled.set(vec4::empty);
 			s_main->matUniforms->nDeforms.set(vec4(0, 0, 0, 0));
 			s_main->matUniforms->time.set(vec4(s_main->stretchPicMaterial->setTime(s_main->floatTime), 0, 0, 0));
 
@@ -787,6 +788,154 @@ static void SetDrawCallGeometry(const DrawCall &dc)
 	}
 }
 
+/// @brief World geometry that can be rendered once into the static shadow map.
+/// @remarks Entities, polygons and CPU or GPU deformed world surfaces are rendered into the shadow map every frame.
+static bool IsStaticShadowCaster(const DrawCall &dc)
+{
+	const Material *mat = dc.material->remappedShader ? dc.material->remappedShader : dc.material;
+	return !dc.entity && dc.vb.type == DrawCall::BufferType::Static && mat->numDeforms == 0;
+}
+
+static void RenderShadowCaster(const bgfx::ViewId viewId, const DrawCall &dc)
+{
+	// Material remapping.
+	Material *mat = dc.material->remappedShader ? dc.material->remappedShader : dc.material;
+
+	if (mat->sort != MaterialSort::Opaque || mat->numUnfoggedPasses == 0 || dc.flags & DrawCallFlags::Sky)
+		return;
+
+	// Don't render first person models.
+	if (dc.entity && (dc.entity->flags & EntityFlags::FirstPerson))
+		return;
+
+	s_main->currentEntity = dc.entity;
+	s_main->matUniforms->time.set(vec4(mat->setTime(s_main->floatTime), 0, 0, 0));
+	s_main->uniforms->depthRangeEnabled.set(vec4::empty);
+	mat->setDeformUniforms(s_main->matUniforms.get());
+	SetDrawCallGeometry(dc);
+	bgfx::setTransform(dc.modelMatrix.get());
+	bgfx::setState(BGFX_STATE_DEPTH_TEST_LEQUAL | BGFX_STATE_WRITE_Z/* | BGFX_STATE_CULL_CW*/);
+	bgfx::submit(viewId, s_main->shaderPrograms[ShaderProgramId::Depth].handle);
+	s_main->currentEntity = nullptr;
+}
+
+/// @brief Render the sun shadow map as cascades fitted to slices of the camera frustum.
+/// @param lightSpaceWorldBounds The world bounds in shadow view space. The whole world shadow projection is fitted to this.
+/// @param cascadeSplits View depth of the far end of each cascade.
+/// @param cascadeScaleOffsets Maps from whole world shadow projection clip space to each cascade's area of the shadow map.
+static void RenderShadowCascades(const RenderCameraArgs &args, vec2 depthRange, const mat4 &shadowViewMatrix, const Bounds &lightSpaceWorldBounds, vec4 *cascadeSplits, vec4 *cascadeScaleOffsets)
+{
+	const int nCascades = s_main->nShadowCascades;
+	const int cascadeSize = nCascades == 1 ? s_main->shadowMapSize : s_main->shadowMapSize / 2;
+	const float zNear = depthRange.x;
+	const float zFar = std::max(zNear + 1.0f, std::min(depthRange.y, g_cvars.shadowDistance.getFloat()));
+	const float tanHalfFovX = tanf(DEG2RAD(args.fov.x) * 0.5f);
+	const float tanHalfFovY = tanf(DEG2RAD(args.fov.y) * 0.5f);
+	const vec3 worldCenter = lightSpaceWorldBounds.midpoint();
+	const vec3 worldHalfSize = lightSpaceWorldBounds.toSize() * 0.5f;
+	float sliceNear = zNear;
+
+	for (int i = 0; i < nCascades; i++)
+	{
+		// Blend logarithmic and uniform splits.
+		const float fraction = (i + 1) / (float)nCascades;
+		const float sliceFar = math::Lerp(zNear + (zFar - zNear) * fraction, zNear * powf(zFar / zNear, fraction), 0.75f);
+		(*cascadeSplits)[i] = sliceFar;
+
+		// Fit a sphere around the frustum slice. Its size doesn't change when the camera rotates, so shadow edges don't shimmer.
+		std::array<vec3, 8> corners;
+
+		for (size_t j = 0; j < corners.size(); j++)
+		{
+			const float d = (j & 1) ? sliceFar : sliceNear;
+			const float x = (j & 2) ? 1.0f : -1.0f;
+			const float y = (j & 4) ? 1.0f : -1.0f;
+			corners[j] = args.position + args.rotation[0] * d + args.rotation[1] * (d * tanHalfFovX * x) + args.rotation[2] * (d * tanHalfFovY * y);
+		}
+
+		vec3 center;
+
+		for (const vec3 &corner : corners)
+			center += corner;
+
+		center = center * (1.0f / corners.size());
+		float radius = 0;
+
+		for (const vec3 &corner : corners)
+			radius = std::max(radius, (corner - center).length());
+
+		// Leave a guard band around the slice, so PCF samples near the edge of a tile don't read the neighbouring cascade.
+		// 2 texels for the 5x5 PCF kernel, 1 for comparison filtering and 1 for texel snapping.
+		const int guardTexels = 4;
+		radius *= cascadeSize / float(cascadeSize - guardTexels * 2);
+
+		// Snap to texels so shadow edges don't crawl when the camera moves.
+		vec3 lsCenter = shadowViewMatrix.transform(center);
+		const float texelSize = radius * 2.0f / cascadeSize;
+		lsCenter.x = floorf(lsCenter.x / texelSize) * texelSize;
+		lsCenter.y = floorf(lsCenter.y / texelSize) * texelSize;
+
+		// Keep the whole world depth range so casters between the sun and the cascade aren't clipped.
+		mat4 projectionMatrix;
+		bx::mtxOrtho((float *)&projectionMatrix, lsCenter.x - radius, lsCenter.x + radius, lsCenter.y - radius, lsCenter.y + radius, lightSpaceWorldBounds.min.z, lightSpaceWorldBounds.max.z, 0.0f, bgfx::getCaps()->homogeneousDepth);
+		const int column = i % 2;
+		const int row = i / 2;
+		const bgfx::ViewId viewId = PushView(s_main->shadowMapFb, BGFX_CLEAR_DEPTH, shadowViewMatrix, projectionMatrix, Rect(column * cascadeSize, row * cascadeSize, cascadeSize, cascadeSize));
+#ifdef _DEBUG
+		bgfx::setViewName(viewId, "ShadowCascade");
+#endif
+		const Frustum cascadeFrustum(projectionMatrix * shadowViewMatrix);
+
+		for (const DrawCall &dc : s_main->drawCalls)
+		{
+			if ((dc.flags & DrawCallFlags::HasBounds) && cascadeFrustum.clipBounds(dc.bounds) == Frustum::ClipResult::Outside)
+				continue;
+
+			RenderShadowCaster(viewId, dc);
+		}
+
+		// Cascades are laid out in a 2x2 grid.
+		const float tileScale = nCascades == 1 ? 1.0f : 0.5f;
+		vec2 tileOffset;
+
+		if (nCascades > 1)
+		{
+			tileOffset.x = column == 0 ? -0.5f : 0.5f;
+			tileOffset.y = row == 0 ? 0.5f : -0.5f;
+		}
+
+		cascadeScaleOffsets[i].x = worldHalfSize.x / radius * tileScale;
+		cascadeScaleOffsets[i].y = worldHalfSize.y / radius * tileScale;
+		cascadeScaleOffsets[i].z = (worldCenter.x - lsCenter.x) / radius * tileScale + tileOffset.x;
+		cascadeScaleOffsets[i].w = (worldCenter.y - lsCenter.y) / radius * tileScale + tileOffset.y;
+		sliceNear = sliceFar;
+	}
+
+	// Unused splits repeat the last one. The shader treats anything past it as unshadowed.
+	for (int i = nCascades; i < g_maxShadowCascades; i++)
+	{
+		(*cascadeSplits)[i] = (*cascadeSplits)[nCascades - 1];
+	}
+}
+
+/// @brief Add lights circling the camera, for measuring dynamic light cost. See r_dynamicLightStress.
+static void AddStressTestDynamicLights(vec3 cameraPosition, int nLights)
+{
+	std::minstd_rand generator(1);
+
+	for (int i = 0; i < nLights; i++)
+	{
+		const float orbit = math::RandomFloat(generator, 64, 1024);
+		const float angle = math::RandomFloat(generator, 0, (float)M_PI * 2) + s_main->floatTime * (0.25f + (i % 3) * 0.25f);
+		const vec3 position = cameraPosition + vec3(cosf(angle) * orbit, sinf(angle) * orbit, math::RandomFloat(generator, -128, 128));
+		DynamicLight light;
+		light.position_type = vec4(position, i % 4 == 0 ? (float)DynamicLight::Capsule : (float)DynamicLight::Point);
+		light.capsuleEnd = vec4(position + vec3(0, 0, 128), 0);
+		light.color_radius = vec4(math::RandomFloat(generator, 0.2f, 1), math::RandomFloat(generator, 0.2f, 1), math::RandomFloat(generator, 0.2f, 1), math::RandomFloat(generator, 100, 300));
+		s_main->dlightManager->add(s_main->frameNo, light);
+	}
+}
+
 static void RenderToStencil(const bgfx::ViewId viewId)
 {
 	const uint32_t stencilWrite = BGFX_STENCIL_TEST_ALWAYS | BGFX_STENCIL_FUNC_REF(1) | BGFX_STENCIL_FUNC_RMASK(0xff) | BGFX_STENCIL_OP_FAIL_S_REPLACE | BGFX_STENCIL_OP_FAIL_Z_REPLACE | BGFX_STENCIL_OP_PASS_Z_REPLACE;
@@ -830,6 +979,96 @@ static vec2 CalculateDepthRange(VisibilityId visId, vec3 position)
 	return vec2(zMin, zMax);
 }
 
+/// @brief Submit a draw call to write depth only, alpha testing if the material has an alpha tested stage.
+static void RenderDepth(bgfx::ViewId viewId, const DrawCall &dc, Material *mat, vec2 depthRange, uint64_t state, uint32_t stencil)
+{
+	s_main->currentEntity = dc.entity;
+	s_main->matUniforms->time.set(vec4(mat->setTime(s_main->floatTime), 0, 0, 0));
+
+	if (dc.zOffset > 0 || dc.zScale > 0)
+	{
+		s_main->uniforms->depthRangeEnabled.set(vec4(1, 0, 0, 0));
+		s_main->uniforms->depthRange.set(vec4(dc.zOffset, dc.zScale, depthRange.x, depthRange.y));
+	}
+	else
+	{
+		s_main->uniforms->depthRangeEnabled.set(vec4::empty);
+	}
+
+	mat->setDeformUniforms(s_main->matUniforms.get());
+	const MaterialStage *alphaTestStage = mat->alphaTestStage;
+	SetDrawCallGeometry(dc);
+	bgfx::setTransform(dc.modelMatrix.get());
+	state |= BGFX_STATE_WRITE_Z;
+
+	// Grab the cull state. Doesn't matter which stage, since it's global to the material.
+	state |= mat->stages[0].getState() & BGFX_STATE_CULL_MASK;
+
+	int shaderVariant = DepthShaderProgramVariant::None;
+
+	if (alphaTestStage)
+	{
+		alphaTestStage->setShaderUniforms(s_main->matStageUniforms.get(), MaterialStageSetUniformsFlags::TexGen);
+		bgfx::setTexture(0, s_main->uniforms->textureSampler.handle, alphaTestStage->bundles[0].textures[0]->getHandle());
+		shaderVariant |= DepthShaderProgramVariant::AlphaTest;
+	}
+	else
+	{
+		s_main->matStageUniforms->alphaTest.set(vec4::empty);
+	}
+
+	bgfx::setState(state);
+
+	if (stencil != BGFX_STENCIL_NONE)
+	{
+		bgfx::setStencil(stencil);
+	}
+
+	bgfx::submit(viewId, s_main->shaderPrograms[ShaderProgramId::Depth + shaderVariant].handle);
+	s_main->currentEntity = nullptr;
+}
+
+/// @brief Whether the depth prepass can write depth for a draw call, so its stages can be drawn with depth equal testing.
+/// @remarks The depth program alpha tests with the first texture of the alpha tested stage, and doesn't generate texture coordinates. Anything it can't match would leave holes where the stages draw.
+static bool IsDepthPrepassCaster(const DrawCall &dc, const Material *mat)
+{
+	if (mat->sort != MaterialSort::Opaque || mat->numUnfoggedPasses == 0 || mat->polygonOffset || (dc.flags & DrawCallFlags::Sky) || !mat->stages[0].depthWrite)
+		return false;
+
+	const MaterialStage *alphaTestStage = mat->alphaTestStage;
+
+	if (alphaTestStage)
+	{
+		const MaterialTextureBundle &bundle = alphaTestStage->bundles[0];
+
+		if (alphaTestStage != &mat->stages[0] || bundle.numImageAnimations > 1 || (bundle.tcGen != MaterialTexCoordGen::None && bundle.tcGen != MaterialTexCoordGen::Texture))
+			return false;
+
+		if (alphaTestStage->alphaGen != MaterialAlphaGen::Identity && alphaTestStage->alphaGen != MaterialAlphaGen::Vertex)
+			return false;
+	}
+
+	return true;
+}
+
+/// @brief Get the fog uniform values for a draw call, calculating them the first time the current camera sees the draw call's fog and entity.
+static Main::CameraFog GetCameraFog(const RenderCameraArgs &args, const mat4 &viewMatrix, const DrawCall &dc)
+{
+	for (const Main::CameraFog &fog : s_main->cameraFogs)
+	{
+		if (fog.fogIndex == dc.fogIndex && fog.entity == dc.entity)
+			return fog;
+	}
+
+	Main::CameraFog fog;
+	fog.fogIndex = dc.fogIndex;
+	fog.entity = dc.entity;
+	const vec3 localViewPosition = dc.entity ? dc.entity->localViewPosition : args.position;
+	world::CalculateFog(dc.fogIndex, dc.modelMatrix, viewMatrix * dc.modelMatrix, args.position, localViewPosition, args.rotation, &fog.color, &fog.distance, &fog.depth, &fog.eyeT);
+	s_main->cameraFogs.push_back(fog);
+	return fog;
+}
+
 static void RenderCamera(const RenderCameraArgs &args)
 {
 	const float polygonDepthOffset = -0.001f;
@@ -944,7 +1183,7 @@ static void RenderCamera(const RenderCameraArgs &args)
 		{
 			for (size_t i = 0; i < world::GetNumSkySurfaces(args.visId); i++)
 			{
-				Sky_Render(&s_main->drawCalls, args.position, depthRange.y, world::GetSkySurface(args.visId, i));
+				Sky_Render(&s_main->drawCalls, world::GetSkySurface(args.visId, i));
 			}
 		}
 
@@ -986,7 +1225,8 @@ static void RenderCamera(const RenderCameraArgs &args)
 	// Render to shadow map. Probes skip this.
 	if (s_main->sunLightEnabled && s_main->isWorldCamera && !isProbe)
 	{
-		Bounds bounds(world::GetBounds());
+		const Bounds worldBounds(world::GetBounds());
+		Bounds bounds(worldBounds);
 		vec3 eye;
 		vec3 center = -s_main->sunLight.direction;
 		vec3 up(0.0f, 1.0f, 0.0f);
@@ -1002,42 +1242,73 @@ static void RenderCamera(const RenderCameraArgs &args)
 
 		mat4 shadowProjectionMatrix;
 		bx::mtxOrtho((float *)&shadowProjectionMatrix, bounds.min.x, bounds.max.x, bounds.min.y, bounds.max.y, bounds.min.z, bounds.max.z, 0.0f, bgfx::getCaps()->homogeneousDepth);
-		const bgfx::ViewId viewId = PushView(s_main->shadowMapFb, BGFX_CLEAR_DEPTH, shadowViewMatrix, shadowProjectionMatrix, Rect(0, 0, s_main->shadowMapSize, s_main->shadowMapSize));
+		vec4 cascadeSplits(FLT_MAX);
+		std::array<vec4, g_maxShadowCascades> cascadeScaleOffsets;
+		cascadeScaleOffsets[0] = vec4(1, 1, 0, 0);
+
+		if (s_main->nShadowCascades > 0)
+		{
+			RenderShadowCascades(args, depthRange, shadowViewMatrix, bounds, &cascadeSplits, cascadeScaleOffsets.data());
+		}
+		else
+		{
+			const Rect shadowMapRect(0, 0, s_main->shadowMapSize, s_main->shadowMapSize);
+			const bool cacheStaticShadows = bgfx::isValid(s_main->staticShadowMapFb.handle);
+
+			// The sun direction and the world bounds determine the shadow view, so the static world only needs to be rendered again if they change.
+			if (cacheStaticShadows && (!s_main->staticShadowMapValid || s_main->staticShadowMapSunDirection != s_main->sunLight.direction || !(s_main->staticShadowMapWorldBounds == worldBounds)))
+			{
+				world::UpdateVisibility(VisibilityId::Shadow, vec3::empty, nullptr);
+				s_main->shadowDrawCalls.clear();
+				world::Render(VisibilityId::Shadow, &s_main->shadowDrawCalls, s_main->sceneRotation);
+				const bgfx::ViewId viewId = PushView(s_main->staticShadowMapFb, BGFX_CLEAR_DEPTH, shadowViewMatrix, shadowProjectionMatrix, shadowMapRect);
 #ifdef _DEBUG
-		bgfx::setViewName(viewId, "ShadowMap");
+				bgfx::setViewName(viewId, "StaticShadowMap");
 #endif
 
-		for (DrawCall &dc : s_main->drawCalls)
-		{
-			// Material remapping.
-			Material *mat = dc.material->remappedShader ? dc.material->remappedShader : dc.material;
+				for (const DrawCall &dc : s_main->shadowDrawCalls)
+				{
+					if (IsStaticShadowCaster(dc))
+					{
+						RenderShadowCaster(viewId, dc);
+					}
+				}
 
-			if (mat->sort != MaterialSort::Opaque || mat->numUnfoggedPasses == 0 || dc.flags & DrawCallFlags::Sky)
-				continue;
+				s_main->staticShadowMapValid = true;
+				s_main->staticShadowMapSunDirection = s_main->sunLight.direction;
+				s_main->staticShadowMapWorldBounds = worldBounds;
+			}
 
-			// Don't render first person models.
-			if (dc.entity && (dc.entity->flags & EntityFlags::FirstPerson))
-				continue;
+			const bgfx::ViewId viewId = PushView(s_main->shadowMapFb, cacheStaticShadows ? BGFX_CLEAR_NONE : BGFX_CLEAR_DEPTH, shadowViewMatrix, shadowProjectionMatrix, shadowMapRect);
+#ifdef _DEBUG
+			bgfx::setViewName(viewId, "ShadowMap");
+#endif
 
-			s_main->currentEntity = dc.entity;
-			s_main->matUniforms->time.set(vec4(mat->setTime(s_main->floatTime), 0, 0, 0));
-			s_main->uniforms->depthRangeEnabled.set(vec4::empty);
-			mat->setDeformUniforms(s_main->matUniforms.get());
-			SetDrawCallGeometry(dc);
-			bgfx::setTransform(dc.modelMatrix.get());
-			bgfx::setState(BGFX_STATE_DEPTH_TEST_LEQUAL | BGFX_STATE_WRITE_Z/* | BGFX_STATE_CULL_CW*/);
-			bgfx::submit(viewId, s_main->shaderPrograms[ShaderProgramId::Depth].handle);
-			s_main->currentEntity = nullptr;
+			if (cacheStaticShadows)
+			{
+				// Start with the cached static world depth and render everything else on top.
+				bgfx::blit(viewId, bgfx::getTexture(s_main->shadowMapFb.handle), 0, 0, bgfx::getTexture(s_main->staticShadowMapFb.handle));
+			}
+
+			for (const DrawCall &dc : s_main->drawCalls)
+			{
+				if (!cacheStaticShadows || !IsStaticShadowCaster(dc))
+				{
+					RenderShadowCaster(viewId, dc);
+				}
+			}
 		}
 
+		s_main->uniforms->shadowCascadeSplits.set(cascadeSplits);
+		s_main->uniforms->shadowCascadeScaleOffset.set(cascadeScaleOffsets.data(), g_maxShadowCascades);
 		s_main->uniforms->lightModelViewProj.set(shadowProjectionMatrix * shadowViewMatrix);
 		s_main->uniforms->shadowMap_TexelSize_DepthBias_NormalBias_SlopeScaleDepthBias.set(vec4(1.0f / s_main->shadowMapSize, g_cvars.shadowDepthBias.getFloat(), g_cvars.shadowNormalBias.getFloat(), g_cvars.shadowSlopeScaleDepthBias.getFloat()));
 		s_main->uniforms->sunLightColor.set(vec4(s_main->sunLight.light * g_cvars.sunLightIntensity.getFloat(), 0));
 		s_main->uniforms->sunLightDir.set(vec4(-s_main->sunLight.direction, 0));
 	}
 
-	// Render depth for soft sprites. MSAA is always off.
-	if (s_main->softSpritesEnabled && s_main->isWorldCamera && !isProbe)
+	// Render depth for soft sprites, unless it can be copied from the scene depth after opaque geometry is rendered. MSAA is always off.
+	if (s_main->softSpritesEnabled && !s_main->softSpriteDepthCopyEnabled && s_main->isWorldCamera && !isProbe)
 	{
 		const bgfx::ViewId viewId = PushView(s_main->depthFb, BGFX_CLEAR_DEPTH, viewMatrix, projectionMatrix, args.rect);
 #ifdef _DEBUG
@@ -1056,62 +1327,7 @@ static void RenderCamera(const RenderCameraArgs &args)
 			if (args.visId == VisibilityId::Reflection && mat->reflective != MaterialReflective::None)
 				continue;
 
-			s_main->currentEntity = dc.entity;
-			s_main->matUniforms->time.set(vec4(mat->setTime(s_main->floatTime), 0, 0, 0));
-
-			if (dc.zOffset > 0 || dc.zScale > 0)
-			{
-				s_main->uniforms->depthRangeEnabled.set(vec4(1, 0, 0, 0));
-				s_main->uniforms->depthRange.set(vec4(dc.zOffset, dc.zScale, depthRange.x, depthRange.y));
-			}
-			else
-			{
-				s_main->uniforms->depthRangeEnabled.set(vec4::empty);
-			}
-
-			mat->setDeformUniforms(s_main->matUniforms.get());
-
-			// See if any of the stages use alpha testing.
-			const MaterialStage *alphaTestStage = nullptr;
-
-			for (const MaterialStage &stage : mat->stages)
-			{
-				if (stage.active && stage.alphaTest != MaterialAlphaTest::None)
-				{
-					alphaTestStage = &stage;
-					break;
-				}
-			}
-
-			SetDrawCallGeometry(dc);
-			bgfx::setTransform(dc.modelMatrix.get());
-			uint64_t state = BGFX_STATE_DEPTH_TEST_LESS | BGFX_STATE_WRITE_Z;
-
-			// Grab the cull state. Doesn't matter which stage, since it's global to the material.
-			state |= mat->stages[0].getState() & BGFX_STATE_CULL_MASK;
-
-			int shaderVariant = DepthShaderProgramVariant::None;
-
-			if (alphaTestStage)
-			{
-				alphaTestStage->setShaderUniforms(s_main->matStageUniforms.get(), MaterialStageSetUniformsFlags::TexGen);
-				bgfx::setTexture(0, s_main->uniforms->textureSampler.handle, alphaTestStage->bundles[0].textures[0]->getHandle());
-				shaderVariant |= DepthShaderProgramVariant::AlphaTest;
-			}
-			else
-			{
-				s_main->matStageUniforms->alphaTest.set(vec4::empty);
-			}
-
-			bgfx::setState(state);
-
-			if (args.flags & RenderCameraFlags::UseStencilTest)
-			{
-				bgfx::setStencil(stencilTest);
-			}
-
-			bgfx::submit(viewId, s_main->shaderPrograms[ShaderProgramId::Depth + shaderVariant].handle);
-			s_main->currentEntity = nullptr;
+			RenderDepth(viewId, dc, mat, depthRange, BGFX_STATE_DEPTH_TEST_LESS, (args.flags & RenderCameraFlags::UseStencilTest) ? stencilTest : BGFX_STENCIL_NONE);
 		}
 	}
 
@@ -1148,14 +1364,54 @@ static void RenderCamera(const RenderCameraArgs &args)
 			renderMode = RENDER_MODE_LIT;
 		else if (!isProbe && g_cvars.debug.getInt() == 1)
 			renderMode = RENDER_MODE_LIGHTMAP;
+		else if (!isProbe && g_cvars.debug.getInt() == 2)
+			renderMode = RENDER_MODE_DYNAMIC_LIGHT_COUNT;
 
 		s_main->uniforms->renderMode.set(vec4((float)renderMode, 0, 0, 0));
 	}
 
+	// Portal and reflection cameras have finished rendering by now, so the fog cache only holds values for this camera.
+	s_main->cameraFogs.clear();
+
+	// Lay down depth for opaque geometry first, so their stages only shade the visible pixels.
+	const bool depthPrepass = g_cvars.depthPrepass.getBool() && s_main->isWorldCamera;
+
+	if (depthPrepass)
+	{
+		for (DrawCall &dc : s_main->drawCalls)
+		{
+			Material *mat = dc.material->remappedShader ? dc.material->remappedShader : dc.material;
+
+			if (!IsDepthPrepassCaster(dc, mat))
+				continue;
+
+			if (args.visId == VisibilityId::Reflection && mat->reflective != MaterialReflective::None)
+				continue;
+
+			RenderDepth(mainViewId, dc, mat, depthRange, BGFX_STATE_DEPTH_TEST_LESS | (IsMsaa(s_main->aa) ? BGFX_STATE_MSAA : 0), (args.flags & RenderCameraFlags::UseStencilTest) ? stencilTest : BGFX_STENCIL_NONE);
+		}
+	}
+
+	// Without a depth pre-pass, soft sprites can only be drawn after the scene depth has been copied.
+	bool softSpriteDepthValid = s_main->softSpritesEnabled && !s_main->softSpriteDepthCopyEnabled;
+	const bool copySoftSpriteDepth = s_main->softSpriteDepthCopyEnabled && s_main->isWorldCamera && !isProbe;
+
 	for (DrawCall &dc : s_main->drawCalls)
 	{
 		assert(dc.material);
 
+		// Draw calls are sorted by material sort, so opaque geometry has all been submitted once a non-opaque draw call is reached.
+		// Copy the scene depth for soft sprites and continue in a new view, so the copy happens between the two.
+		if (copySoftSpriteDepth && !softSpriteDepthValid && dc.material->sort > MaterialSort::Opaque)
+		{
+			Blit("SoftSpriteDepth", bgfx::getTexture(s_main->sceneFb.handle, s_main->sceneDepthAttachment), bgfx::getTexture(s_main->depthFb.handle));
+			mainViewId = PushView(s_main->sceneFb, BGFX_CLEAR_NONE, viewMatrix, projectionMatrix, args.rect, PushViewFlags::Sequential);
+#ifdef _DEBUG
+			bgfx::setViewName(mainViewId, "SceneBlended");
+#endif
+			softSpriteDepthValid = true;
+		}
+
 		// Material remapping.
 		Material *mat = dc.material->remappedShader ? dc.material->remappedShader : dc.material;
 
@@ -1175,21 +1431,17 @@ static void RenderCamera(const RenderCameraArgs &args)
 				s_main->uniforms->bloom_Enabled_Write_Scale.set(vec4::empty);
 			}
 
-			s_main->uniforms->depthRangeEnabled.set(vec4(1, 0, 0, 0));
 			s_main->uniforms->depthRange.set(vec4(dc.zOffset, dc.zScale, depthRange.x, depthRange.y));
-			s_main->uniforms->dynamicLight_Num_Intensity.set(vec4::empty);
-			s_main->matUniforms->nDeforms.set(vec4(0, 0, 0, 0));
-			s_main->matStageUniforms->alphaTest.set(vec4::empty);
-			s_main->matStageUniforms->baseColor.set(vec4::white);
-			s_main->matStageUniforms->generators.set(vec4::empty);
-			s_main->matStageUniforms->lightType.set(vec4::empty);
-			s_main->matStageUniforms->vertexColor.set(vec4::black);
+			s_main->uniforms->viewOrigin.set(args.position);
+
+			// outerbox is rt, bk, lf, ft, up, dn. The shader wants +x, -x, +y, -y, +z, -z.
 			const int sky_texorder[6] = { 0, 2, 1, 3, 4, 5 };
-			bgfx::setTexture(TextureUnit::Diffuse, s_main->matStageUniforms->diffuseSampler.handle, mat->sky.outerbox[sky_texorder[dc.skyboxSide]]->getHandle());
-#ifdef _DEBUG
-			bgfx::setTexture(TextureUnit::Diffuse2, s_main->matStageUniforms->diffuseSampler2.handle, g_textureCache->getWhite()->getHandle());
-			bgfx::setTexture(TextureUnit::Light, s_main->matStageUniforms->lightSampler.handle, g_textureCache->getWhite()->getHandle());
-#endif
+
+			for (int i = 0; i < 6; i++)
+			{
+				bgfx::setTexture(TextureUnit::Skybox + i, s_main->matStageUniforms->skyboxSamplers[i].handle, mat->sky.outerbox[sky_texorder[i]]->getHandle());
+			}
+
 			SetDrawCallGeometry(dc);
 			bgfx::setTransform(dc.modelMatrix.get());
 			uint64_t state = dc.state;
@@ -1204,7 +1456,7 @@ static void RenderCamera(const RenderCameraArgs &args)
 				bgfx::setStencil(stencilTest);
 			}
 
-			bgfx::submit(mainViewId, s_main->shaderPrograms[ShaderProgramId::Generic].handle);
+			bgfx::submit(mainViewId, s_main->shaderPrograms[ShaderProgramId::Skybox].handle);
 			continue;
 		}
 
@@ -1213,13 +1465,39 @@ static void RenderCamera(const RenderCameraArgs &args)
 		if (mat->numUnfoggedPasses == 0 && !doFogPass)
 			continue;
 
+		const bool depthPrepassed = depthPrepass && IsDepthPrepassCaster(dc, mat);
+
+		// Opaque materials can blend the fog color in the generic shader instead of drawing a separate fog pass. The last stage has to overwrite the framebuffer, since anything drawn on top of it wouldn't be fogged.
+		// If an earlier stage is drawn, the last stage can't alpha test either, or the earlier stage would show through unfogged where it discards.
+		const MaterialStage *fogStage = nullptr;
+
+		if (doFogPass && mat->fogPass == MaterialFogPass::Equal)
+		{
+			int nActiveStages = 0;
+
+			for (const MaterialStage &stage : mat->stages)
+			{
+				if (stage.active)
+				{
+					fogStage = &stage;
+					nActiveStages++;
+				}
+			}
+
+			if (fogStage && ((fogStage->getState() & BGFX_STATE_BLEND_MASK) != 0 || (!s_main->fastPathEnabled && g_cvars.textureVariation.getBool() && fogStage->textureVariation)))
+				fogStage = nullptr;
+
+			if (fogStage && nActiveStages > 1 && fogStage->alphaTest != MaterialAlphaTest::None)
+				fogStage = nullptr;
+		}
+
 		s_main->currentEntity = dc.entity;
 		s_main->matUniforms->time.set(vec4(mat->setTime(s_main->floatTime), 0, 0, 0));
-		const mat4 modelViewMatrix(viewMatrix * dc.modelMatrix);
 
 		if (s_main->isWorldCamera)
 		{
-			s_main->dlightManager->updateUniforms(s_main->uniforms.get());
+			// Only the scene camera can use view space clusters. Portal, reflection and skybox cameras use the world grid.
+			s_main->dlightManager->updateUniforms(s_main->uniforms.get(), args.visId == VisibilityId::Main);
 		}
 		else
 		{
@@ -1249,15 +1527,15 @@ static void RenderCamera(const RenderCameraArgs &args)
 			s_main->entityUniforms->lightDirection.set(vec4(s_main->currentEntity->lightDir, 0));
 		}
 
-		vec4 fogColor, fogDistance, fogDepth;
-		float eyeT;
+		Main::CameraFog fog;
 
 		if (!dc.material->noFog && dc.fogIndex >= 0)
 		{
-			world::CalculateFog(dc.fogIndex, dc.modelMatrix, modelViewMatrix, args.position, localViewPosition, args.rotation, &fogColor, &fogDistance, &fogDepth, &eyeT);
-			s_main->uniforms->fogDistance.set(fogDistance);
-			s_main->uniforms->fogDepth.set(fogDepth);
-			s_main->uniforms->fogEyeT.set(eyeT);
+			fog = GetCameraFog(args, viewMatrix, dc);
+			s_main->uniforms->fogColor.set(fog.color);
+			s_main->uniforms->fogDistance.set(fog.distance);
+			s_main->uniforms->fogDepth.set(fog.depth);
+			s_main->uniforms->fogEyeT.set(fog.eyeT);
 		}
 
 		for (const MaterialStage &stage : mat->stages)
@@ -1283,16 +1561,21 @@ static void RenderCamera(const RenderCameraArgs &args)
 				s_main->uniforms->depthRangeEnabled.set(vec4::empty);
 			}
 
+			vec4 fogEnabled;
+
 			if (!dc.material->noFog && dc.fogIndex >= 0 && stage.adjustColorsForFog != MaterialAdjustColorsForFog::None)
 			{
-				s_main->uniforms->fogEnabled.set(vec4(1, 0, 0, 0));
+				fogEnabled.x = 1;
 				s_main->matStageUniforms->fogColorMask.set(stage.getFogColorMask());
 			}
-			else
+
+			if (&stage == fogStage)
 			{
-				s_main->uniforms->fogEnabled.set(vec4::empty);
+				fogEnabled.y = 1;
 			}
 
+			s_main->uniforms->fogEnabled.set(fogEnabled);
+
 			stage.setShaderUniforms(s_main->matStageUniforms.get());
 			stage.setTextureSamplers(s_main->matStageUniforms.get());
 			SetDrawCallGeometry(dc);
@@ -1302,13 +1585,20 @@ static void RenderCamera(const RenderCameraArgs &args)
 			if (IsMsaa(s_main->aa))
 				state |= BGFX_STATE_MSAA;
 
+			if (depthPrepassed)
+			{
+				// Depth has already been written, so only shade the visible pixels.
+				state &= ~(BGFX_STATE_DEPTH_TEST_MASK | BGFX_STATE_WRITE_Z);
+				state |= BGFX_STATE_DEPTH_TEST_EQUAL;
+			}
+
 			int shaderVariant = GenericShaderProgramVariant::None;
 
 			if (stage.alphaTest != MaterialAlphaTest::None)
 			{
 				shaderVariant |= GenericShaderProgramVariant::AlphaTest;
 			}
-			else if (s_main->isWorldCamera && s_main->softSpritesEnabled && dc.softSpriteDepth > 0)
+			else if (s_main->isWorldCamera && softSpriteDepthValid && dc.softSpriteDepth > 0)
 			{
 				shaderVariant |= GenericShaderProgramVariant::SoftSprite;
 				bgfx::setTexture(TextureUnit::Depth, s_main->matStageUniforms->depthSampler.handle, bgfx::getTexture(s_main->depthFb.handle));
@@ -1378,8 +1668,8 @@ static void RenderCamera(const RenderCameraArgs &args)
 			bgfx::submit(mainViewId, s_main->shaderPrograms[ShaderProgramId::TextureColor].handle);
 		}
 
-		// Do fog pass.
-		if (doFogPass)
+		// Do fog pass if the fog couldn't be blended by the last stage.
+		if (doFogPass && !fogStage)
 		{
 			if (s_main->bloomEnabled)
 			{
@@ -1399,7 +1689,7 @@ static void RenderCamera(const RenderCameraArgs &args)
 				s_main->uniforms->depthRangeEnabled.set(vec4::empty);
 			}
 
-			s_main->matStageUniforms->color.set(fogColor);
+			s_main->matStageUniforms->color.set(fog.color);
 			SetDrawCallGeometry(dc);
 			bgfx::setTransform(dc.modelMatrix.get());
 			uint64_t state = dc.state | BGFX_STATE_BLEND_ALPHA;
@@ -1551,7 +1841,12 @@ void RenderScene(const SceneDefinition &scene)
 		// Update scene dynamic lights.
 		if (isWorldScene)
 		{
-			s_main->dlightManager->updateTextures(s_main->frameNo);
+			if (g_cvars.dynamicLightStress.getInt() > 0)
+			{
+				AddStressTestDynamicLights(scene.position, g_cvars.dynamicLightStress.getInt());
+			}
+
+			s_main->dlightManager->updateTextures(s_main->frameNo, scene.position, scene.rotation, scene.fov);
 		}
 
 		// Render camera(s).
@@ -1590,17 +1885,9 @@ void RenderScene(const SceneDefinition &scene)
 		{
 			if (s_main->bloomEnabled)
 			{
-				// OpenGL resolves multisampled bloom into a temp texture.
-				const bool msaaResolve = bgfx::getRendererType() == bgfx::RendererType::OpenGL && IsMsaa(s_main->aa);
-
-				if (msaaResolve)
-				{
-					Blit("BloomMsaaResolve", bgfx::getTexture(s_main->sceneFb.handle, s_main->sceneBloomAttachment), bgfx::getTexture(s_main->sceneTempFb.handle));
-				}
-
-				// Render to quarter size framebuffer.
+				// Render to quarter size framebuffer. bgfx resolves every multisampled scene attachment when the scene views finish, so this reads the resolved bloom attachment directly instead of blitting it first.
 				const Rect bloomRect(0, 0, window::GetWidth() / 4, window::GetHeight() / 4);
-				bgfx::setTexture(0, s_main->uniforms->textureSampler.handle, msaaResolve ? bgfx::getTexture(s_main->sceneTempFb.handle) : bgfx::getTexture(s_main->sceneFb.handle, s_main->sceneBloomAttachment));
+				bgfx::setTexture(0, s_main->uniforms->textureSampler.handle, bgfx::getTexture(s_main->sceneFb.handle, s_main->sceneBloomAttachment));
 				RenderScreenSpaceQuad("BloomCopy", s_main->bloomFb[0], ShaderProgramId::Texture, BGFX_STATE_WRITE_RGB, BGFX_CLEAR_NONE, s_main->isTextureOriginBottomLeft, bloomRect);
 
 				// Ping-pong guassian blur in quarter size framebuffers
@@ -1611,27 +1898,23 @@ void RenderScene(const SceneDefinition &scene)
 					RenderScreenSpaceQuad("BloomBlur", s_main->bloomFb[!i], ShaderProgramId::GaussianBlur, BGFX_STATE_WRITE_RGB, BGFX_CLEAR_NONE, s_main->isTextureOriginBottomLeft, bloomRect);
 				}
 
-				// Apply bloom. If using SMAA, we need to read color, so blit into the original bloom texture which is no longer used.
 				s_main->uniforms->bloom_Enabled_Write_Scale.set(vec4(1, 0, g_cvars.bloomScale.getFloat(), 0));
-				bgfx::setTexture(0, s_main->uniforms->textureSampler.handle, bgfx::getTexture(s_main->sceneFb.handle));
-				bgfx::setTexture(1, s_main->uniforms->bloomSampler.handle, bgfx::getTexture(s_main->bloomFb[0].handle));
-				RenderScreenSpaceQuad("BloomApply", s_main->aa == AntiAliasing::SMAA ? s_main->sceneTempFb : s_main->defaultFb, ShaderProgramId::Bloom, BGFX_STATE_WRITE_RGB, BGFX_CLEAR_NONE, s_main->isTextureOriginBottomLeft);
+
+				// Apply bloom. SMAA neighborhood blending applies it instead, saving a full screen pass.
+				if (s_main->aa != AntiAliasing::SMAA)
+				{
+					bgfx::setTexture(0, s_main->uniforms->textureSampler.handle, bgfx::getTexture(s_main->sceneFb.handle));
+					bgfx::setTexture(1, s_main->uniforms->bloomSampler.handle, bgfx::getTexture(s_main->bloomFb[0].handle));
+					RenderScreenSpaceQuad("BloomApply", s_main->defaultFb, ShaderProgramId::Bloom, BGFX_STATE_WRITE_RGB, BGFX_CLEAR_NONE, s_main->isTextureOriginBottomLeft);
+				}
 			}
 
 			if (s_main->aa == AntiAliasing::SMAA)
 			{
 				s_main->uniforms->smaaMetrics.set(vec4(1.0f / rect.w, 1.0f / rect.h, (float)rect.w, (float)rect.h));
 
-				// Edge detection.
-				if (s_main->bloomEnabled)
-				{
-					bgfx::setTexture(0, s_main->uniforms->smaaColorSampler.handle, bgfx::getTexture(s_main->sceneTempFb.handle));
-				}
-				else
-				{
-					bgfx::setTexture(0, s_main->uniforms->smaaColorSampler.handle, bgfx::getTexture(s_main->sceneFb.handle));
-				}
-
+				// Edge detection. Bloom hasn't been applied yet, but it's too low frequency to add edges.
+				bgfx::setTexture(0, s_main->uniforms->smaaColorSampler.handle, bgfx::getTexture(s_main->sceneFb.handle));
 				RenderScreenSpaceQuad("SMAAEdgeDetection", s_main->smaaEdgesFb, ShaderProgramId::SMAAEdgeDetection, BGFX_STATE_WRITE_RGB, BGFX_CLEAR_COLOR, s_main->isTextureOriginBottomLeft);
 
 				// Blending weight calculation.
@@ -1640,18 +1923,18 @@ void RenderScene(const SceneDefinition &scene)
 				bgfx::setTexture(2, s_main->uniforms->smaaSearchSampler.handle, s_main->smaaSearchTex);
 				RenderScreenSpaceQuad("SMAABlendingWeightCalculation", s_main->smaaBlendFb, ShaderProgramId::SMAABlendingWeightCalculation, BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A, BGFX_CLEAR_COLOR, s_main->isTextureOriginBottomLeft);
 
-				// Neighborhood blending.
+				// Neighborhood blending, applying bloom too.
+				int shaderVariant = SMAANeighborhoodBlendingShaderProgramVariant::None;
+				bgfx::setTexture(0, s_main->uniforms->smaaColorSampler.handle, bgfx::getTexture(s_main->sceneFb.handle));
+				bgfx::setTexture(1, s_main->uniforms->smaaBlendSampler.handle, bgfx::getTexture(s_main->smaaBlendFb.handle));
+
 				if (s_main->bloomEnabled)
 				{
-					bgfx::setTexture(0, s_main->uniforms->smaaColorSampler.handle, bgfx::getTexture(s_main->sceneTempFb.handle));
-				}
-				else
-				{
-					bgfx::setTexture(0, s_main->uniforms->smaaColorSampler.handle, bgfx::getTexture(s_main->sceneFb.handle));
+					bgfx::setTexture(2, s_main->uniforms->bloomSampler.handle, bgfx::getTexture(s_main->bloomFb[0].handle));
+					shaderVariant |= SMAANeighborhoodBlendingShaderProgramVariant::Bloom;
 				}
 
-				bgfx::setTexture(1, s_main->uniforms->smaaBlendSampler.handle, bgfx::getTexture(s_main->smaaBlendFb.handle));
-				RenderScreenSpaceQuad("SMAANeighborhoodBlending", s_main->defaultFb, ShaderProgramId::SMAANeighborhoodBlending, BGFX_STATE_WRITE_RGB, BGFX_CLEAR_NONE, s_main->isTextureOriginBottomLeft);
+				RenderScreenSpaceQuad("SMAANeighborhoodBlending", s_main->defaultFb, ShaderProgramId::Enum(ShaderProgramId::SMAANeighborhoodBlending + shaderVariant), BGFX_STATE_WRITE_RGB, BGFX_CLEAR_NONE, s_main->isTextureOriginBottomLeft);
 			}
 			else if (!s_main->bloomEnabled && !s_main->fastPathEnabled)
 			{
@@ -1760,15 +2043,7 @@ void EndFrame()
 
 	if (s_main->debugDraw == DebugDraw::Bloom && s_main->bloomEnabled)
 	{
-		if (bgfx::getRendererType() == bgfx::RendererType::OpenGL && IsMsaa(s_main->aa))
-		{
-			RenderDebugDraw(bgfx::getTexture(s_main->sceneTempFb.handle));
-		}
-		else
-		{
-			RenderDebugDraw(bgfx::getTexture(s_main->sceneFb.handle, s_main->sceneBloomAttachment));
-		}
-
+		RenderDebugDraw(bgfx::getTexture(s_main->sceneFb.handle, s_main->sceneBloomAttachment));
 		RenderDebugDraw(bgfx::getTexture(s_main->bloomFb[0].handle), 0, 1);
 		RenderDebugDraw(bgfx::getTexture(s_main->bloomFb[1].handle), 0, 2);
 	}
@@ -1822,6 +2097,7 @@ void EndFrame()
 		debug |= BGFX_DEBUG_TEXT;
 
 	bgfx::setDebug(debug);
+	s_main->textureCache->updateStreaming();
 	s_main->frameNo = bgfx::frame(s_main->captureFrame);
 	s_main->captureFrame = false;
 
@@ -79,6 +79,8 @@ void ConsoleVariables::initialize()
 
 	bgfx_stats = interface::Cvar_Get("r_bgfx_stats", "0", ConsoleVariableFlags::Cheat);
 	bloomScale = interface::Cvar_Get("r_bloomScale", "1.0", ConsoleVariableFlags::Archive);
+	compactWorldGeometry = interface::Cvar_Get("r_compactWorldGeometry", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
+	compactWorldGeometry.setDescription("Free the CPU copy of world vertices after they're uploaded to the GPU, keeping only positions. The light baker can't be used.\n");
 	debug = interface::Cvar_Get("r_debug", "", 0);
 	debugDraw = interface::Cvar_Get("r_debugDraw", "", 0);
 	debugDraw.setDescription(
@@ -91,18 +93,48 @@ void ConsoleVariables::initialize()
 		"shadow     Shadows\n"
 		"smaa       SMAA edges and weights\n");
 	debugDrawSize = interface::Cvar_Get("r_debugDrawSize", "256", ConsoleVariableFlags::Archive);
+	depthPrepass = interface::Cvar_Get("r_depthPrepass", "0", ConsoleVariableFlags::Archive);
+	depthPrepass.setDescription("Write the depth of opaque geometry before drawing it, so materials with several stages only shade visible pixels.\n");
+	dynamicLightClusters = interface::Cvar_Get("r_dynamicLightClusters", "1", ConsoleVariableFlags::Archive);
+	dynamicLightClusters.setDescription("Assign dynamic lights to view space clusters for the main camera instead of a coarse world space grid.\n");
 	dynamicLightIntensity = interface::Cvar_Get("r_dynamicLightIntensity", "1", ConsoleVariableFlags::Archive);
 	dynamicLightScale = interface::Cvar_Get("r_dynamicLightScale", "0.7", ConsoleVariableFlags::Archive);
+	dynamicLightStress = interface::Cvar_Get("r_dynamicLightStress", "0", ConsoleVariableFlags::Cheat);
+	dynamicLightStress.checkRange(0, (float)DynamicLightManager::maxLights, true);
+	dynamicLightStress.setDescription("Add this many moving dynamic lights around the camera. Use with r_bgfx_stats and r_debug 2 to measure dynamic light cost.\n");
+	dynamicLightThreads = interface::Cvar_Get("r_dynamicLightThreads", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
+	dynamicLightThreads.checkRange(0, 4, true);
+	dynamicLightThreads.setDescription("Number of worker threads that help the main thread assign dynamic lights to cells.\n");
+	lodCurveError = interface::Cvar_Get("r_lodCurveError", "250", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Cheat);
+	lodCurveError.setDescription("Curved surface LOD. Higher values keep more detail at a distance. 0 always uses full detail.\n");
 	picmip = interface::Cvar_Get("r_picmip", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
 	picmip.checkRange(0, 16, true);
 	railWidth = interface::Cvar_Get("r_railWidth", "16", ConsoleVariableFlags::Archive);
 	railCoreWidth = interface::Cvar_Get("r_railCoreWidth", "6", ConsoleVariableFlags::Archive);
 	railSegmentLength = interface::Cvar_Get("r_railSegmentLength", "32", ConsoleVariableFlags::Archive);
 	screenshotJpegQuality = interface::Cvar_Get("r_screenshotJpegQuality", "90", ConsoleVariableFlags::Archive);
+	shaderCache = interface::Cvar_Get("r_shaderCache", "1", ConsoleVariableFlags::Archive);
+	shaderCache.setDescription("Cache the combined shader file text and shader name index between renderer restarts.\n");
+	shadowCascades = interface::Cvar_Get("r_shadowCascades", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
+	shadowCascades.checkRange(0, g_maxShadowCascades, true);
+	shadowCascades.setDescription(
+		"0    One sun shadow map covering the whole world\n"
+		"1-4  Split the sun shadow map into this many cascades fitted to the camera\n");
+	shadowCascadeSize = interface::Cvar_Get("r_shadowCascadeSize", "1024", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
+	shadowCascadeSize.checkRange(256, 4096, true);
+	shadowCascadeSize.setDescription("Width and height of each sun shadow cascade in texels.\n");
 	shadowDepthBias = interface::Cvar_Get("r_shadowDepthBias", "0", ConsoleVariableFlags::Archive);
+	shadowDistance = interface::Cvar_Get("r_shadowDistance", "2048", ConsoleVariableFlags::Archive);
+	shadowDistance.setDescription("How far from the camera sun shadow cascades reach.\n");
 	shadowNormalBias = interface::Cvar_Get("r_shadowNormalBias", "1", ConsoleVariableFlags::Archive);
 	shadowSlopeScaleDepthBias = interface::Cvar_Get("r_shadowSlopeScaleDepthBias", "0", ConsoleVariableFlags::Archive);
 	sunLightIntensity = interface::Cvar_Get("r_sunLightIntensity", "1", ConsoleVariableFlags::Archive);
+	textureMemory = interface::Cvar_Get("r_textureMemory", "0", ConsoleVariableFlags::Archive);
+	textureMemory.setDescription(
+		"0    Free all textures when the renderer restarts, e.g. on map change\n"
+		"<n>  Keep textures between map changes, evicting unused textures to stay under n MB\n");
+	textureStreaming = interface::Cvar_Get("r_textureStreaming", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
+	textureStreaming.setDescription("Load textures with only their low resolution mips, and stream the rest in after the map has started rendering.\n");
 	textureVariation = interface::Cvar_Get("r_textureVariation", "0", ConsoleVariableFlags::Archive);
 	wireframe = interface::Cvar_Get("r_wireframe", "0", ConsoleVariableFlags::Cheat);
 
@@ -127,6 +159,9 @@ namespace main {
 
 static BgfxCallback bgfxCallback;
 
+/// Kept between renderer restarts when r_textureMemory is set.
+static std::unique_ptr<TextureCache> s_retainedTextureCache;
+
 static AntiAliasing AntiAliasingFromString(const char *s)
 {
 	if (util::Stricmp(s, "msaa2x") == 0)
@@ -219,6 +254,22 @@ static void Cmd_CaptureFrame()
 	s_main->captureFrame = true;
 }
 
+static void Cmd_BenchmarkPointQueries()
+{
+	if (world::IsLoaded())
+	{
+		world::BenchmarkPointQueries();
+	}
+}
+
+static void Cmd_BenchmarkDynamicLights()
+{
+	if (world::IsLoaded())
+	{
+		s_main->dlightManager->benchmark(s_main->frameNo);
+	}
+}
+
 static void Cmd_PickMaterial()
 {
 	if (world::IsLoaded())
@@ -233,6 +284,12 @@ static void Cmd_PrintMaterials()
 		g_materialCache->printMaterials();
 }
 
+static void Cmd_PrintTextures()
+{
+	if (g_textureCache)
+		g_textureCache->printTextures();
+}
+
 static void Cmd_Screenshot()
 {
 	TakeScreenshot("tga");
@@ -300,9 +357,12 @@ void Initialize()
 #if defined(USE_LIGHT_BAKER)
 	interface::Cmd_Add("r_bakeLights", Cmd_BakeLights);
 #endif
+	interface::Cmd_Add("r_benchmarkDynamicLights", Cmd_BenchmarkDynamicLights);
+	interface::Cmd_Add("r_benchmarkPointQueries", Cmd_BenchmarkPointQueries);
 	interface::Cmd_Add("r_captureFrame", Cmd_CaptureFrame);
 	interface::Cmd_Add("r_pickMaterial", Cmd_PickMaterial);
 	interface::Cmd_Add("r_printMaterials", Cmd_PrintMaterials);
+	interface::Cmd_Add("r_printTextures", Cmd_PrintTextures);
 	interface::Cmd_Add("screenshot", Cmd_Screenshot);
 	interface::Cmd_Add("screenshotJPEG", Cmd_ScreenshotJPEG);
 	interface::Cmd_Add("screenshotPNG", Cmd_ScreenshotPNG);
@@ -427,11 +487,22 @@ void Initialize()
 	s_main->halfTexelOffset = caps->rendererType == bgfx::RendererType::Direct3D9 ? 0.5f : 0;
 	s_main->isTextureOriginBottomLeft = caps->rendererType == bgfx::RendererType::OpenGL || caps->rendererType == bgfx::RendererType::OpenGLES;
 	Vertex::init();
+	CompactVertex::init();
 	s_main->uniforms = std::make_unique<Uniforms>();
 	s_main->entityUniforms = std::make_unique<Uniforms_Entity>();
 	s_main->matUniforms = std::make_unique<Uniforms_Material>();
 	s_main->matStageUniforms = std::make_unique<Uniforms_MaterialStage>();
-	s_main->textureCache = std::make_unique<TextureCache>();
+	if (s_retainedTextureCache && s_retainedTextureCache->isCompatible())
+	{
+		s_main->textureCache = std::move(s_retainedTextureCache);
+		s_main->textureCache->beginRegistration();
+	}
+	else
+	{
+		s_retainedTextureCache.reset();
+		s_main->textureCache = std::make_unique<TextureCache>();
+	}
+
 	g_textureCache = s_main->textureCache.get();
 	s_main->materialCache = std::make_unique<MaterialCache>();
 	g_materialCache = s_main->materialCache.get();
@@ -488,6 +559,14 @@ void Initialize()
 	programMap[ShaderProgramId::SMAABlendingWeightCalculation] = { FragmentShaderId::SMAABlendingWeightCalculation, VertexShaderId::SMAABlendingWeightCalculation };
 	programMap[ShaderProgramId::SMAAEdgeDetection] = { FragmentShaderId::SMAAEdgeDetection, VertexShaderId::SMAAEdgeDetection };
 	programMap[ShaderProgramId::SMAANeighborhoodBlending] = { FragmentShaderId::SMAANeighborhoodBlending, VertexShaderId::SMAANeighborhoodBlending };
+
+	programMap[ShaderProgramId::SMAANeighborhoodBlending + SMAANeighborhoodBlendingShaderProgramVariant::Bloom] =
+	{
+		FragmentShaderId::SMAANeighborhoodBlending_Bloom,
+		VertexShaderId::SMAANeighborhoodBlending
+	};
+
+	programMap[ShaderProgramId::Skybox] = { FragmentShaderId::Skybox, VertexShaderId::Skybox };
 	programMap[ShaderProgramId::Texture] = { FragmentShaderId::Texture, VertexShaderId::Texture };
 	programMap[ShaderProgramId::TextureColor] = { FragmentShaderId::TextureColor, VertexShaderId::Texture };
 	programMap[ShaderProgramId::TextureDebug] = { FragmentShaderId::TextureDebug, VertexShaderId::Texture };
@@ -504,10 +583,10 @@ void Initialize()
 		const ShaderProgramIdMap &pm = programMap[i];
 
 		// Don't create shader programs that won't be used.
-		if (s_main->aa != AntiAliasing::SMAA && (i == ShaderProgramId::SMAABlendingWeightCalculation || i == ShaderProgramId::SMAAEdgeDetection || i == ShaderProgramId::SMAANeighborhoodBlending))
+		if (s_main->aa != AntiAliasing::SMAA && (i == ShaderProgramId::SMAABlendingWeightCalculation || i == ShaderProgramId::SMAAEdgeDetection || (i >= ShaderProgramId::SMAANeighborhoodBlending && i < ShaderProgramId::SMAANeighborhoodBlending + SMAANeighborhoodBlendingShaderProgramVariant::Num)))
 			continue;
 
-		if (!s_main->bloomEnabled && (i == ShaderProgramId::Bloom || i == ShaderProgramId::GaussianBlur))
+		if (!s_main->bloomEnabled && (i == ShaderProgramId::Bloom || i == ShaderProgramId::GaussianBlur || i == ShaderProgramId::SMAANeighborhoodBlending + SMAANeighborhoodBlendingShaderProgramVariant::Bloom))
 			continue;
 
 		if (i >= (int)ShaderProgramId::Generic && i <= int(ShaderProgramId::Generic + GenericShaderProgramVariant::Num))
@@ -575,7 +654,16 @@ void LoadWorld(const char *name)
 
 	if (s_main->softSpritesEnabled)
 	{
-		s_main->depthFb.handle = bgfx::createFrameBuffer(bgfx::BackbufferRatio::Equal, bgfx::TextureFormat::D24S8);
+		s_main->softSpriteDepthCopyEnabled = !IsMsaa(s_main->aa) && (bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_BLIT);
+
+		if (s_main->softSpriteDepthCopyEnabled)
+		{
+			s_main->depthFb.handle = bgfx::createFrameBuffer(bgfx::BackbufferRatio::Equal, bgfx::TextureFormat::D24S8, rtClampFlags | BGFX_TEXTURE_BLIT_DST);
+		}
+		else
+		{
+			s_main->depthFb.handle = bgfx::createFrameBuffer(bgfx::BackbufferRatio::Equal, bgfx::TextureFormat::D24S8);
+		}
 	}
 
 	if (s_main->bloomEnabled)
@@ -588,12 +676,6 @@ void LoadWorld(const char *name)
 		s_main->sceneBloomAttachment = 1;
 		s_main->sceneDepthAttachment = 2;
 
-		// Bloom needs a temp BGRA8 destination for SMAA. GL needs it for MSAA resolve.
-		if (s_main->aa == AntiAliasing::SMAA || (bgfx::getRendererType() == bgfx::RendererType::OpenGL && IsMsaa(s_main->aa)))
-		{
-			s_main->sceneTempFb.handle = bgfx::createFrameBuffer(bgfx::BackbufferRatio::Equal, bgfx::TextureFormat::BGRA8, rtClampFlags);
-		}
-
 		for (size_t i = 0; i < s_main->nBloomFrameBuffers; i++)
 		{
 			s_main->bloomFb[i].handle = bgfx::createFrameBuffer(bgfx::BackbufferRatio::Quarter, bgfx::TextureFormat::BGRA8, rtClampFlags);
@@ -627,7 +709,30 @@ void LoadWorld(const char *name)
 
 	if (s_main->sunLightEnabled)
 	{
-		s_main->shadowMapFb.handle = bgfx::createFrameBuffer(s_main->shadowMapSize, s_main->shadowMapSize, bgfx::TextureFormat::D24S8, BGFX_SAMPLER_COMPARE_LEQUAL | rtClampFlags);
+		s_main->staticShadowMapValid = false;
+		s_main->nShadowCascades = g_cvars.shadowCascades.getInt();
+		const int cascadeSize = g_cvars.shadowCascadeSize.getInt();
+
+		// Cascades are laid out in a 2x2 grid.
+		if (s_main->nShadowCascades == 0)
+		{
+			s_main->shadowMapSize = 4096;
+		}
+		else
+		{
+			s_main->shadowMapSize = s_main->nShadowCascades == 1 ? cascadeSize : cascadeSize * 2;
+		}
+
+		// The static world can only be cached when the shadow map covers the whole world.
+		if (s_main->nShadowCascades == 0 && (bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_BLIT))
+		{
+			s_main->shadowMapFb.handle = bgfx::createFrameBuffer(s_main->shadowMapSize, s_main->shadowMapSize, bgfx::TextureFormat::D24S8, BGFX_SAMPLER_COMPARE_LEQUAL | BGFX_TEXTURE_BLIT_DST | rtClampFlags);
+			s_main->staticShadowMapFb.handle = bgfx::createFrameBuffer(s_main->shadowMapSize, s_main->shadowMapSize, bgfx::TextureFormat::D24S8, rtClampFlags);
+		}
+		else
+		{
+			s_main->shadowMapFb.handle = bgfx::createFrameBuffer(s_main->shadowMapSize, s_main->shadowMapSize, bgfx::TextureFormat::D24S8, BGFX_SAMPLER_COMPARE_LEQUAL | rtClampFlags);
+		}
 	}
 
 	// Load the world.
@@ -635,6 +740,12 @@ void LoadWorld(const char *name)
 	s_main->dlightManager->initializeGrid();
 }
 
+void EndRegistration()
+{
+	if (s_main.get() && s_main->textureCache)
+		s_main->textureCache->endRegistration();
+}
+
 void Shutdown(bool destroyWindow)
 {
 #if defined(USE_LIGHT_BAKER)
@@ -643,9 +754,25 @@ void Shutdown(bool destroyWindow)
 	interface::Cmd_Remove("r_bakeLights");
 #endif
 	world::Unload();
+
+	if (s_main.get())
+	{
+		// Materials reference textures, so destroy them before the texture cache.
+		s_main->materialCache.reset();
+
+		if (!destroyWindow && g_cvars.textureMemory.getInt() > 0)
+			s_retainedTextureCache = std::move(s_main->textureCache);
+	}
+
+	if (destroyWindow)
+		s_retainedTextureCache.reset();
+
+	interface::Cmd_Remove("r_benchmarkDynamicLights");
+	interface::Cmd_Remove("r_benchmarkPointQueries");
 	interface::Cmd_Remove("r_captureFrame");
 	interface::Cmd_Remove("r_pickMaterial");
 	interface::Cmd_Remove("r_printMaterials");
+	interface::Cmd_Remove("r_printTextures");
 	interface::Cmd_Remove("screenshot");
 	interface::Cmd_Remove("screenshotJPEG");
 	interface::Cmd_Remove("screenshotPNG");
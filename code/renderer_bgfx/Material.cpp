@@ -153,6 +153,17 @@ void Material::finish()
 	{
 		fogPass = MaterialFogPass::LessOrEqual;
 	}
+
+	alphaTestStage = nullptr;
+
+	for (const MaterialStage &stage : stages)
+	{
+		if (stage.active && stage.alphaTest != MaterialAlphaTest::None)
+		{
+			alphaTestStage = &stage;
+			break;
+		}
+	}
 }
 
 int Material::collapseStagesToGLSL()
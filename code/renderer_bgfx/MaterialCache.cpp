@@ -295,11 +295,18 @@ MaterialCache::MaterialCache() : hashTable_(), textHashTable_()
 	skins_.push_back(std::move(skin));
 }
 
+MaterialCache::~MaterialCache()
+{
+	for (std::unique_ptr<Material> &m : materials_)
+		referenceTextures(*m.get(), false);
+}
+
 Material *MaterialCache::createMaterial(const Material &base)
 {
 	auto m = std::make_unique<Material>(base);
 	meta::OnMaterialCreate(m.get());
 	m->finish();
+	referenceTextures(*m.get(), true);
 	m->index = (int)materials_.size();
 	m->sortedIndex = (int)materials_.size();
 	size_t hash = generateHash(m->name, hashTableSize_);
@@ -460,13 +467,14 @@ void MaterialCache::remapMaterial(const char *oldName, const char *newName, cons
 	{
 		if (util::Stricmp(m->name, strippedName) == 0)
 		{
-			if (m != materials[1])
-			{
-				m->remappedShader = materials[1];
-			}
-			else
+			Material *remappedShader = m != materials[1] ? materials[1] : nullptr;
+
+			if (m->remappedShader != remappedShader)
 			{
-				m->remappedShader = nullptr;
+				m->remappedShader = remappedShader;
+
+				// Static shadow casters are chosen by remapped material.
+				main::InvalidateStaticShadows();
 			}
 		}
 	}
@@ -570,6 +578,32 @@ size_t MaterialCache::generateHash(const char *fname, size_t size)
 	return hash;
 }
 
+void MaterialCache::referenceTextures(const Material &material, bool add)
+{
+	auto reference = [add](const Texture *texture)
+	{
+		if (add)
+			g_textureCache->addReference(texture);
+		else
+			g_textureCache->removeReference(texture);
+	};
+
+	for (const MaterialStage &stage : material.stages)
+	{
+		for (const MaterialTextureBundle &bundle : stage.bundles)
+		{
+			for (const Texture *texture : bundle.textures)
+				reference(texture);
+		}
+	}
+
+	for (size_t i = 0; i < 6; i++)
+	{
+		reference(material.sky.outerbox[i]);
+		reference(material.sky.innerbox[i]);
+	}
+}
+
 void MaterialCache::createInternalShaders()
 {
 	Material m("<default>");
@@ -578,6 +612,95 @@ void MaterialCache::createInternalShaders()
 	defaultMaterial_ = createMaterial(m);
 }
 
+struct ShaderTextCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t key;
+	uint32_t textLength;
+	uint32_t nEntries;
+};
+
+const char *MaterialCache::shaderTextCacheFilename_ = "shadercache.dat";
+
+/// FNV-1a.
+static uint32_t HashShaderFileData(uint32_t hash, const void *data, size_t length)
+{
+	auto bytes = (const uint8_t *)data;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+void MaterialCache::scanShaderFile(ShaderFile *file)
+{
+	// Do a simple check on the shader structure in that file to make sure one bad shader file cannot fuck up all other shaders.
+	char *p = file->text;
+	file->warning[0] = 0;
+	util::BeginParseSession(file->filename);
+
+	while(1)
+	{
+		char *oldP = p;
+		char *token = util::Parse(&p, true);
+		
+		if (!*token)
+			break;
+
+		char shaderName[MAX_QPATH];
+		util::Strncpyz(shaderName, token, sizeof(shaderName));
+		int shaderLine = util::GetCurrentParseLine();
+		token = util::Parse(&p, true);
+
+		if (token[0] != '{' || token[1] != '\0')
+		{
+			// Can't use VarArgs here, it isn't thread safe. Truncate the found token so the warning always fits.
+			char found[MAX_QPATH * 2] = { 0 };
+
+			if (token[0])
+			{
+				util::Sprintf(found, sizeof(found), " (found \"%.*s\" on line %d)", MAX_QPATH, token, util::GetCurrentParseLine());
+			}
+
+			util::Sprintf(file->warning, sizeof(file->warning), "WARNING: Shader file %s. Shader \"%s\" on line %d missing opening brace%s. Ignoring rest of shader file.\n", file->filename, shaderName, shaderLine, found);
+			*oldP = 0;
+			break;
+		}
+
+		if (!util::SkipBracedSection(&p, 1))
+		{
+			util::Sprintf(file->warning, sizeof(file->warning), "WARNING: Shader file %s. Shader \"%s\" on line %d missing closing brace. Ignoring rest of shader file.\n", file->filename, shaderName, shaderLine);
+			*oldP = 0;
+			break;
+		}
+	}
+
+	file->textLength = util::Compress(file->text);
+
+	// look for shader names
+	p = file->text;
+
+	while (1)
+	{
+		char *oldp = p;
+		char *token = util::Parse(&p, true);
+
+		if (token[0] == 0)
+			break;
+
+		ShaderTextEntry entry;
+		entry.offset = uint32_t(oldp - file->text);
+		entry.hash = (uint32_t)generateHash(token, textHashTableSize_);
+		file->entries.push_back(entry);
+		util::SkipBracedSection(&p, 0);
+	}
+}
+
 void MaterialCache::scanAndLoadShaderFiles()
 {
 	// scan for shader files
@@ -592,123 +715,173 @@ void MaterialCache::scanAndLoadShaderFiles()
 
 	numShaderFiles = std::min(numShaderFiles, (int)maxShaderFiles_);
 
-	// load and parse shader files
-	char *buffers[maxShaderFiles_] = {NULL};
-	long sum = 0;
+	// load shader files
+	std::vector<ShaderFile> files(numShaderFiles);
+
+	// The cache key is derived from the version, the shader filenames, their sizes and their contents. Any change invalidates the cache.
+	uint32_t cacheKey = HashShaderFileData(2166136261u, &shaderTextCacheVersion_, sizeof(shaderTextCacheVersion_));
 
 	for (int i = 0; i < numShaderFiles; i++)
 	{
-		char filename[MAX_QPATH];
+		ShaderFile &file = files[i];
 
 		// look for a .mtr file first
 		{
-			util::Sprintf(filename, sizeof(filename), "scripts/%s", shaderFiles[i]);
+			util::Sprintf(file.filename, sizeof(file.filename), "scripts/%s", shaderFiles[i]);
 
 			char *ext;
 
-			if ((ext = strrchr(filename, '.')))
+			if ((ext = strrchr(file.filename, '.')))
 			{
 				strcpy(ext, ".mtr");
 			}
 
-			if (interface::FS_ReadFile(filename, NULL) <= 0)
+			if (interface::FS_ReadFile(file.filename, NULL) <= 0)
 			{
-				util::Sprintf(filename, sizeof(filename), "scripts/%s", shaderFiles[i]);
+				util::Sprintf(file.filename, sizeof(file.filename), "scripts/%s", shaderFiles[i]);
 			}
 		}
 		
-		interface::PrintDeveloperf("...loading '%s'\n", filename);
-		long summand = interface::FS_ReadFile(filename, (uint8_t **)&buffers[i]);
-		
-		if (!buffers[i])
-			interface::Error("Couldn't load %s", filename);
+		interface::PrintDeveloperf("...loading '%s'\n", file.filename);
+		file.fileLength = interface::FS_ReadFile(file.filename, (uint8_t **)&file.text);
 		
-		// Do a simple check on the shader structure in that file to make sure one bad shader file cannot fuck up all other shaders.
-		char *p = buffers[i];
-		util::BeginParseSession(filename);
+		if (!file.text)
+			interface::Error("Couldn't load %s", file.filename);
 
-		while(1)
-		{
-			char *oldP = p;
-			char *token = util::Parse(&p, true);
-			
-			if (!*token)
-				break;
-
-			char shaderName[MAX_QPATH];
-			util::Strncpyz(shaderName, token, sizeof(shaderName));
-			int shaderLine = util::GetCurrentParseLine();
-			token = util::Parse(&p, true);
+		cacheKey = HashShaderFileData(cacheKey, file.filename, strlen(file.filename));
+		cacheKey = HashShaderFileData(cacheKey, &file.fileLength, sizeof(file.fileLength));
+		cacheKey = HashShaderFileData(cacheKey, file.text, (size_t)file.fileLength);
+	}
 
-			if (token[0] != '{' || token[1] != '\0')
-			{
-				interface::PrintWarningf("WARNING: Shader file %s. Shader \"%s\" on line %d missing opening brace", filename, shaderName, shaderLine);
+	// free up memory
+	interface::FS_FreeListFiles(shaderFiles);
+	std::vector<ShaderTextEntry> entries;
 
-				if (token[0])
-				{
-					interface::PrintWarningf(" (found \"%s\" on line %d)", token, util::GetCurrentParseLine());
-				}
+	if (g_cvars.shaderCache.getBool() && readShaderTextCache(cacheKey, &entries))
+	{
+		interface::PrintDeveloperf("...using shader cache '%s'\n", shaderTextCacheFilename_);
 
-				interface::PrintWarningf(". Ignoring rest of shader file.\n");
-				*oldP = 0;
-				break;
-			}
+		for (ShaderFile &file : files)
+			interface::FS_FreeReadFile((uint8_t *)file.text);
 
-			if (!util::SkipBracedSection(&p, 1))
-			{
-				interface::PrintWarningf("WARNING: Shader file %s. Shader \"%s\" on line %d missing closing brace. Ignoring rest of shader file.\n", filename, shaderName, shaderLine);
-				*oldP = 0;
-				break;
-			}
-		}
-			
-		if (buffers[i])
-			sum += summand;		
+		createTextHashTable(entries);
+		return;
 	}
 
+	// Files are independent, so validate, compress and scan them in parallel.
+	util::ParallelFor(files.size(), [&](size_t i) { scanShaderFile(&files[i]); });
+
 	// build single large buffer
-	shaderText_.resize(sum + numShaderFiles * 2);
-	shaderText_[0] = '\0';
-	char *textEnd = shaderText_.data();
+	size_t sum = 0;
+
+	for (ShaderFile &file : files)
+	{
+		if (file.warning[0])
+			interface::PrintWarningf("%s", file.warning);
+
+		sum += file.textLength + 1;
+	}
+
+	shaderText_.resize(sum + 1);
+	size_t textOffset = 0;
  
-	// free in reverse order, so the temp files are all dumped
+	// Combine in reverse order. Shader names are added to the hash table in text order, so the first definition of a shader in the combined text wins.
 	for (int i = numShaderFiles - 1; i >= 0 ; i--)
 	{
-		if (!buffers[i])
-			continue;
+		ShaderFile &file = files[i];
+		memcpy(&shaderText_[textOffset], file.text, file.textLength);
+
+		for (ShaderTextEntry entry : file.entries)
+		{
+			entry.offset += (uint32_t)textOffset;
+			entries.push_back(entry);
+		}
 
-		strcat(textEnd, buffers[i]);
-		strcat(textEnd, "\n");
-		textEnd += strlen(textEnd);
-		interface::FS_FreeReadFile((uint8_t *)buffers[i]);
+		textOffset += file.textLength;
+		shaderText_[textOffset++] = '\n';
+		interface::FS_FreeReadFile((uint8_t *)file.text);
 	}
 
-	util::Compress(shaderText_.data());
+	shaderText_[textOffset] = '\0';
+	createTextHashTable(entries);
 
-	// free up memory
-	interface::FS_FreeListFiles(shaderFiles);
+	if (g_cvars.shaderCache.getBool())
+		writeShaderTextCache(cacheKey, entries);
+}
 
-	// look for shader names
-	int textHashTable_Sizes[textHashTableSize_];
-	memset(textHashTable_Sizes, 0, sizeof(textHashTable_Sizes));
-	int size = 0;
-	char *p = shaderText_.data();
+bool MaterialCache::readShaderTextCache(uint32_t key, std::vector<ShaderTextEntry> *entries)
+{
+	if (!interface::FS_FileExists(shaderTextCacheFilename_))
+		return false;
 
-	while (1)
-	{
-		char *token = util::Parse(&p, true);
+	ReadOnlyFile file(shaderTextCacheFilename_);
 
-		if (token[0] == 0)
-			break;
+	if (!file.isValid() || file.getLength() < sizeof(ShaderTextCacheHeader))
+		return false;
 
-		size_t hash = generateHash(token, textHashTableSize_);
-		textHashTable_Sizes[hash]++;
-		size++;
-		util::SkipBracedSection(&p, 0);
+	ShaderTextCacheHeader header;
+	memcpy(&header, file.getData(), sizeof(header));
+
+	if (memcmp(header.magic, "SHTC", 4) != 0 || header.version != shaderTextCacheVersion_ || header.key != key)
+		return false;
+
+	if (header.textLength == 0 || file.getLength() != sizeof(header) + header.textLength + header.nEntries * sizeof(ShaderTextEntry))
+		return false;
+
+	const uint8_t *data = file.getData() + sizeof(header);
+
+	// Text must be null terminated.
+	if (data[header.textLength - 1] != 0)
+		return false;
+
+	shaderText_.resize(header.textLength);
+	memcpy(shaderText_.data(), data, header.textLength);
+	data += header.textLength;
+	entries->resize(header.nEntries);
+	memcpy(entries->data(), data, header.nEntries * sizeof(ShaderTextEntry));
+
+	for (const ShaderTextEntry &entry : *entries)
+	{
+		if (entry.offset >= header.textLength || entry.hash >= textHashTableSize_)
+		{
+			shaderText_.clear();
+			entries->clear();
+			return false;
+		}
 	}
 
-	size += textHashTableSize_;
-	auto hashMem = (char *)interface::Hunk_Alloc(size * sizeof(char *));
+	return true;
+}
+
+void MaterialCache::writeShaderTextCache(uint32_t key, const std::vector<ShaderTextEntry> &entries) const
+{
+	ShaderTextCacheHeader header;
+	memcpy(header.magic, "SHTC", 4);
+	header.version = shaderTextCacheVersion_;
+	header.key = key;
+	header.textLength = (uint32_t)shaderText_.size();
+	header.nEntries = (uint32_t)entries.size();
+	std::vector<uint8_t> buffer(sizeof(header) + header.textLength + header.nEntries * sizeof(ShaderTextEntry));
+	uint8_t *data = buffer.data();
+	memcpy(data, &header, sizeof(header));
+	data += sizeof(header);
+	memcpy(data, shaderText_.data(), header.textLength);
+	data += header.textLength;
+	memcpy(data, entries.data(), header.nEntries * sizeof(ShaderTextEntry));
+	interface::FS_WriteFile(shaderTextCacheFilename_, buffer.data(), buffer.size());
+}
+
+void MaterialCache::createTextHashTable(const std::vector<ShaderTextEntry> &entries)
+{
+	int textHashTable_Sizes[textHashTableSize_];
+	memset(textHashTable_Sizes, 0, sizeof(textHashTable_Sizes));
+
+	for (const ShaderTextEntry &entry : entries)
+		textHashTable_Sizes[entry.hash]++;
+
+	// Each bucket is null terminated.
+	const size_t size = entries.size() + textHashTableSize_;
+	auto hashMem = (char *)interface::Hunk_Alloc(int(size * sizeof(char *)));
 
 	for (int i = 0; i < textHashTableSize_; i++)
 	{
@@ -716,22 +889,10 @@ void MaterialCache::scanAndLoadShaderFiles()
 		hashMem = ((char *) hashMem) + ((textHashTable_Sizes[i] + 1) * sizeof(char *));
 	}
 
-	// look for shader names
 	memset(textHashTable_Sizes, 0, sizeof(textHashTable_Sizes));
-	p = shaderText_.data();
 
-	while (1)
-	{
-		char *oldp = p;
-		char *token = util::Parse(&p, true);
-
-		if (token[0] == 0)
-			break;
-
-		size_t hash = generateHash(token, textHashTableSize_);
-		textHashTable_[hash][textHashTable_Sizes[hash]++] = oldp;
-		util::SkipBracedSection(&p, 0);
-	}
+	for (const ShaderTextEntry &entry : entries)
+		textHashTable_[entry.hash][textHashTable_Sizes[entry.hash]++] = &shaderText_[entry.offset];
 }
 
 void MaterialCache::createExternalShaders()
@@ -91,6 +91,11 @@ uint64_t MaterialStage::getState() const
 	return state;
 }
 
+MaterialTexCoordGen MaterialStage::getTexCoordGen() const
+{
+	return material->isSky ? MaterialTexCoordGen::SkyCloud : bundles[0].tcGen;
+}
+
 void MaterialStage::setShaderUniforms(Uniforms_MaterialStage *uniforms, int flags) const
 {
 	uniforms->alphaTest.set((float)alphaTest);
@@ -113,7 +118,7 @@ void MaterialStage::setShaderUniforms(Uniforms_MaterialStage *uniforms, int flag
 	if (flags & (MaterialStageSetUniformsFlags::ColorGen | MaterialStageSetUniformsFlags::TexGen))
 	{
 		vec4 generators;
-		generators[Uniforms_MaterialStage::Generators::TexCoord] = (float)bundles[0].tcGen;
+		generators[Uniforms_MaterialStage::Generators::TexCoord] = (float)getTexCoordGen();
 		generators[Uniforms_MaterialStage::Generators::Color] = (float)rgbGen;
 		generators[Uniforms_MaterialStage::Generators::Alpha] = (float)alphaGen;
 		uniforms->generators.set(generators);
@@ -146,6 +151,10 @@ void MaterialStage::setShaderUniforms(Uniforms_MaterialStage *uniforms, int flag
 			uniforms->tcGenVector0.set(bundles[0].tcGenVectors[0]);
 			uniforms->tcGenVector1.set(bundles[0].tcGenVectors[1]);
 		}
+		else if (getTexCoordGen() == MaterialTexCoordGen::SkyCloud)
+		{
+			uniforms->tcGenVector0.set(vec4(material->sky.cloudHeight, 0, 0, 0));
+		}
 	}
 }
 
@@ -597,6 +606,21 @@ bool Material::hasAutoSpriteDeform() const
 	return false;
 }
 
+void Material::setTextureStreamingPriority(float priority) const
+{
+	for (const MaterialStage &stage : stages)
+	{
+		if (!stage.active)
+			break;
+
+		for (const MaterialTextureBundle &bundle : stage.bundles)
+		{
+			for (const Texture *texture : bundle.textures)
+				g_textureCache->setStreamingPriority(texture, priority);
+		}
+	}
+}
+
 void Material::doAutoSpriteDeform(const mat3 &sceneRotation, Vertex *vertices, uint32_t nVertices, uint16_t *indices, uint32_t nIndices, float *softSpriteDepth) const
 {
 	assert(vertices);
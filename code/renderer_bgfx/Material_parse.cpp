@@ -1865,8 +1865,6 @@ void Material::parseSkyParms(char **text)
 		sky.cloudHeight = 512;
 	}
 
-	Sky_InitializeTexCoords(sky.cloudHeight);
-
 	// innerbox
 	token = util::Parse(text, false);
 
@@ -643,7 +643,21 @@ bool Model_md3::load(const ReadOnlyFile &file)
 
 		for (uint32_t j = 0; j < surface.nIndices; j++)
 		{
-			indices[startIndex + j] = startVertex + fileIndices[j];
+			indices[startIndex + j] = (uint16_t)fileIndices[j];
+		}
+
+		// Reorder triangles for the post-transform vertex cache. Autosprite deforms expect the original quad order.
+		bool hasAutoSpriteDeform = false;
+
+		for (const Material *material : surface.materials)
+			hasAutoSpriteDeform |= material && material->hasAutoSpriteDeform();
+
+		if (!hasAutoSpriteDeform)
+			util::OptimizeVertexCache(&indices[startIndex], surface.nIndices, fs.nVertices);
+
+		for (uint32_t j = 0; j < surface.nIndices; j++)
+		{
+			indices[startIndex + j] += startVertex;
 		}
 
 		startIndex += surface.nIndices;
@@ -665,8 +679,7 @@ bool Model_md3::load(const ReadOnlyFile &file)
 	// Animated models (models with more than 1 frame) have their surface vertices merged into a single system memory vertex array for each frame.
 	if (!isAnimated)
 	{
-		const bgfx::Memory *verticesMem = bgfx::alloc(sizeof(Vertex) * nVertices_);
-		auto vertices = (Vertex *)verticesMem->data;
+		std::vector<Vertex> vertices(nVertices_);
 		frames_[0].vertices.resize(nVertices_);
 		size_t startVertex = 0;
 
@@ -691,7 +704,7 @@ bool Model_md3::load(const ReadOnlyFile &file)
 			startVertex += fs.nVertices;
 		}
 
-		vertexBuffer_.handle = bgfx::createVertexBuffer(verticesMem, Vertex::decl);
+		vertexBuffer_.handle = bgfx::createVertexBuffer(CompactVertex::copy(vertices.data(), nVertices_), CompactVertex::decl);
 	}
 	else
 	{
@@ -211,14 +211,11 @@ static	int	neighbors[8][2] = {
 	}
 }
 
-static int MakeMeshIndexes(int width, int height, Vertex ctrl[MAX_GRID_SIZE][MAX_GRID_SIZE],
-							 uint16_t indexes[(MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3])
+static int MakeMeshIndexes(int width, int height, uint16_t indexes[(MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3])
 {
 	int             i, j;
 	int             numIndexes;
 	int             w, h;
-	Vertex      *dv;
-	static Vertex       ctrl2[MAX_GRID_SIZE * MAX_GRID_SIZE];
 
 	h = height - 1;
 	w = width - 1;
@@ -245,16 +242,6 @@ static int MakeMeshIndexes(int width, int height, Vertex ctrl[MAX_GRID_SIZE][MAX
 		}
 	}
 
-	// FIXME: use more elegant way
-	for(i = 0; i < width; i++)
-	{
-		for(j = 0; j < height; j++)
-		{
-			dv = &ctrl2[j * width + i];
-			*dv = ctrl[j][i];
-		}
-	}
-
 	return numIndexes;
 }
 
@@ -410,6 +397,217 @@ void Patch_Free( Patch *grid ) {
 	free(grid);
 }
 
+/*
+=================
+Patch_CreateLodIndices
+
+Triangulate the rows and columns of the grid with a lod error no greater than maxError.
+The edges are always kept, so patches in the same lod group line up.
+Returns false if no rows or columns are removed.
+=================
+*/
+bool Patch_CreateLodIndices( const Patch *grid, float maxError, std::vector<uint16_t> *indexes ) {
+	int widthTable[MAX_GRID_SIZE], heightTable[MAX_GRID_SIZE];
+	int lodWidth, lodHeight;
+	int i, j;
+
+	// determine which rows and columns of the subdivision we are actually going to use
+	widthTable[0] = 0;
+	lodWidth = 1;
+	for ( i = 1 ; i < grid->width-1 ; i++ ) {
+		if ( grid->widthLodError[i] <= maxError ) {
+			widthTable[lodWidth] = i;
+			lodWidth++;
+		}
+	}
+	widthTable[lodWidth] = grid->width-1;
+	lodWidth++;
+
+	heightTable[0] = 0;
+	lodHeight = 1;
+	for ( i = 1 ; i < grid->height-1 ; i++ ) {
+		if ( grid->heightLodError[i] <= maxError ) {
+			heightTable[lodHeight] = i;
+			lodHeight++;
+		}
+	}
+	heightTable[lodHeight] = grid->height-1;
+	lodHeight++;
+
+	if ( lodWidth == grid->width && lodHeight == grid->height ) {
+		return false;
+	}
+
+	// same vertex order as MakeMeshIndexes
+	indexes->clear();
+	indexes->reserve( (lodWidth-1) * (lodHeight-1) * 6 );
+	for ( i = 0 ; i < lodHeight-1 ; i++ ) {
+		for ( j = 0 ; j < lodWidth-1 ; j++ ) {
+			const uint16_t v1 = heightTable[i] * grid->width + widthTable[j+1];
+			const uint16_t v2 = heightTable[i] * grid->width + widthTable[j];
+			const uint16_t v3 = heightTable[i+1] * grid->width + widthTable[j];
+			const uint16_t v4 = heightTable[i+1] * grid->width + widthTable[j+1];
+
+			indexes->push_back( v2 );
+			indexes->push_back( v3 );
+			indexes->push_back( v1 );
+
+			indexes->push_back( v1 );
+			indexes->push_back( v3 );
+			indexes->push_back( v4 );
+		}
+	}
+
+	return true;
+}
+
+/*
+=================
+R_MergedWidthPoints
+
+returns true if there are grid points merged on a width edge
+=================
+*/
+static bool R_MergedWidthPoints( const Patch *grid, int offset ) {
+	int i, j;
+
+	for ( i = 1 ; i < grid->width-1 ; i++ ) {
+		for ( j = i + 1 ; j < grid->width-1 ; j++ ) {
+			if ( fabs(grid->verts[i + offset].pos.x - grid->verts[j + offset].pos.x) > .1 ) continue;
+			if ( fabs(grid->verts[i + offset].pos.y - grid->verts[j + offset].pos.y) > .1 ) continue;
+			if ( fabs(grid->verts[i + offset].pos.z - grid->verts[j + offset].pos.z) > .1 ) continue;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+=================
+R_MergedHeightPoints
+
+returns true if there are grid points merged on a height edge
+=================
+*/
+static bool R_MergedHeightPoints( const Patch *grid, int offset ) {
+	int i, j;
+
+	for ( i = 1 ; i < grid->height-1 ; i++ ) {
+		for ( j = i + 1 ; j < grid->height-1 ; j++ ) {
+			if ( fabs(grid->verts[grid->width * i + offset].pos.x - grid->verts[grid->width * j + offset].pos.x) > .1 ) continue;
+			if ( fabs(grid->verts[grid->width * i + offset].pos.y - grid->verts[grid->width * j + offset].pos.y) > .1 ) continue;
+			if ( fabs(grid->verts[grid->width * i + offset].pos.z - grid->verts[grid->width * j + offset].pos.z) > .1 ) continue;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool R_PointsEqual( const vec3 &a, const vec3 &b ) {
+	return fabs(a.x - b.x) <= .1 && fabs(a.y - b.y) <= .1 && fabs(a.z - b.z) <= .1;
+}
+
+/*
+=================
+R_FixSharedEdgeLodError
+
+Copy the lod error of the points on one of grid1's edges to the matching points on grid2's edges.
+Returns true if any points are shared.
+=================
+*/
+static bool R_FixSharedEdgeLodError( const Patch *grid1, int nPoints, int start, int stride, const float *lodError, Patch *grid2 ) {
+	bool touch = false;
+	int k, l, m, offset2;
+
+	for ( k = 1 ; k < nPoints-1 ; k++ ) {
+		const vec3 &pos = grid1->verts[start + k * stride].pos;
+
+		for ( m = 0 ; m < 2 ; m++ ) {
+			offset2 = m ? (grid2->height-1) * grid2->width : 0;
+			if ( R_MergedWidthPoints( grid2, offset2 ) )
+				continue;
+			for ( l = 1 ; l < grid2->width-1 ; l++ ) {
+				if ( !R_PointsEqual( pos, grid2->verts[l + offset2].pos ) )
+					continue;
+				// ok the points are equal and should have the same lod error
+				grid2->widthLodError[l] = lodError[k];
+				touch = true;
+			}
+		}
+
+		for ( m = 0 ; m < 2 ; m++ ) {
+			offset2 = m ? grid2->width-1 : 0;
+			if ( R_MergedHeightPoints( grid2, offset2 ) )
+				continue;
+			for ( l = 1 ; l < grid2->height-1 ; l++ ) {
+				if ( !R_PointsEqual( pos, grid2->verts[grid2->width * l + offset2].pos ) )
+					continue;
+				// ok the points are equal and should have the same lod error
+				grid2->heightLodError[l] = lodError[k];
+				touch = true;
+			}
+		}
+	}
+
+	return touch;
+}
+
+/*
+=================
+Patch_FixSharedVertexLodError
+
+Patches in the same lod group (same lodOrigin and lodRadius) always pick the same lod.
+Give points shared along their edges the same lod error too, so the same rows and columns
+are removed on both sides and there are no cracks.
+=================
+*/
+void Patch_FixSharedVertexLodError( const std::vector<Patch *> &grids ) {
+	std::vector<Patch *> stack;
+
+	for ( size_t i = 0 ; i < grids.size() ; i++ ) {
+		if ( grids[i]->lodFixed ) {
+			continue;
+		}
+
+		grids[i]->lodFixed = 2;
+		stack.push_back( grids[i] );
+
+		while ( !stack.empty() ) {
+			Patch *grid1 = stack.back();
+			stack.pop_back();
+
+			for ( size_t j = i + 1 ; j < grids.size() ; j++ ) {
+				Patch *grid2 = grids[j];
+
+				if ( grid2->lodFixed == 2 ) continue;
+				if ( grid1->lodRadius != grid2->lodRadius ) continue;
+				if ( grid1->lodOrigin != grid2->lodOrigin ) continue;
+
+				bool touch = false;
+
+				for ( int n = 0 ; n < 2 ; n++ ) {
+					const int offset = n ? (grid1->height-1) * grid1->width : 0;
+					if ( !R_MergedWidthPoints( grid1, offset ) ) {
+						touch |= R_FixSharedEdgeLodError( grid1, grid1->width, offset, 1, grid1->widthLodError, grid2 );
+					}
+				}
+
+				for ( int n = 0 ; n < 2 ; n++ ) {
+					const int offset = n ? grid1->width-1 : 0;
+					if ( !R_MergedHeightPoints( grid1, offset ) ) {
+						touch |= R_FixSharedEdgeLodError( grid1, grid1->height, offset, grid1->width, grid1->heightLodError, grid2 );
+					}
+				}
+
+				if ( touch ) {
+					grid2->lodFixed = 2;
+					stack.push_back( grid2 );
+				}
+			}
+		}
+	}
+}
+
 /*
 =================
 Patch_Subdivide
@@ -423,10 +621,12 @@ Patch *Patch_Subdivide( int width, int height, const Vertex *points) {
 	float		len, maxLen;
 	int			dir;
 	int			t;
-	Vertex	ctrl[MAX_GRID_SIZE][MAX_GRID_SIZE];
 	float		errorTable[2][MAX_GRID_SIZE];
 	int			numIndexes;
-	static uint16_t indexes[(MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3];
+
+	// Scratch buffers are heap allocated instead of static so patches can be subdivided on multiple threads.
+	auto ctrl = std::make_unique<Vertex[][MAX_GRID_SIZE]>(MAX_GRID_SIZE);
+	std::vector<uint16_t> indexes((MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3);
 	int consecutiveComplete;
 
 	for ( i = 0 ; i < width ; i++ ) {
@@ -525,7 +725,7 @@ Patch *Patch_Subdivide( int width, int height, const Vertex *points) {
 			j += 2;
 		}
 
-		Transpose( width, height, ctrl );
+		Transpose( width, height, ctrl.get() );
 		t = width;
 		width = height;
 		height = t;
@@ -533,7 +733,7 @@ Patch *Patch_Subdivide( int width, int height, const Vertex *points) {
 
 
 	// put all the aproximating points on the curve
-	PutPointsOnCurve( ctrl, width, height );
+	PutPointsOnCurve( ctrl.get(), width, height );
 
 	// cull out any rows or columns that are colinear
 	for ( i = 1 ; i < width-1 ; i++ ) {
@@ -567,22 +767,22 @@ Patch *Patch_Subdivide( int width, int height, const Vertex *points) {
 	// the results should be visually identical with or
 	// without this step
 	if ( height > width ) {
-		Transpose( width, height, ctrl );
+		Transpose( width, height, ctrl.get() );
 		InvertErrorTable( errorTable, width, height );
 		t = width;
 		width = height;
 		height = t;
-		InvertCtrl( width, height, ctrl );
+		InvertCtrl( width, height, ctrl.get() );
 	}
 #endif
 
 	// calculate indexes
-	numIndexes = MakeMeshIndexes(width, height, ctrl, indexes);
+	numIndexes = MakeMeshIndexes(width, height, indexes.data());
 
 	// calculate normals
-	MakeMeshNormals( width, height, ctrl );
+	MakeMeshNormals( width, height, ctrl.get() );
 
-	return R_CreateSurfaceGridMesh(width, height, ctrl, errorTable, numIndexes, indexes);
+	return R_CreateSurfaceGridMesh(width, height, ctrl.get(), errorTable, numIndexes, indexes.data());
 }
 
 } // namespace renderer
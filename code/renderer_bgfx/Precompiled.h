@@ -50,6 +50,7 @@ If you have questions concerning this license or the applicable additional terms
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
 #include <map>
 #include <memory>
 #include <vector>
@@ -83,6 +84,8 @@ extern "C"
 #include "bgfx/platform.h"
 #include "bx/debug.h"
 #include "bx/math.h"
+#include "bx/simd_t.h"
+#include "bx/sort.h"
 #include "bx/string.h"
 #include "bx/timer.h"
 
@@ -120,20 +123,32 @@ struct ConsoleVariables
 	ConsoleVariable backend;
 	ConsoleVariable bgfx_stats;
 	ConsoleVariable bloomScale;
+	ConsoleVariable compactWorldGeometry;
 	ConsoleVariable debug;
 	ConsoleVariable debugDraw;
 	ConsoleVariable debugDrawSize;
+	ConsoleVariable depthPrepass;
+	ConsoleVariable dynamicLightClusters;
 	ConsoleVariable dynamicLightIntensity;
 	ConsoleVariable dynamicLightScale;
+	ConsoleVariable dynamicLightStress;
+	ConsoleVariable dynamicLightThreads;
+	ConsoleVariable lodCurveError;
 	ConsoleVariable picmip;
 	ConsoleVariable railWidth;
 	ConsoleVariable railCoreWidth;
 	ConsoleVariable railSegmentLength;
 	ConsoleVariable screenshotJpegQuality;
+	ConsoleVariable shaderCache;
+	ConsoleVariable shadowCascades;
+	ConsoleVariable shadowCascadeSize;
 	ConsoleVariable shadowDepthBias;
+	ConsoleVariable shadowDistance;
 	ConsoleVariable shadowNormalBias;
 	ConsoleVariable shadowSlopeScaleDepthBias;
 	ConsoleVariable sunLightIntensity;
+	ConsoleVariable textureMemory;
+	ConsoleVariable textureStreaming;
 	ConsoleVariable textureVariation;
 	ConsoleVariable wireframe;
 
@@ -167,7 +182,10 @@ struct DrawCallFlags
 		/// @brief Either world surfaceFlags SURF_SKY (e.g. space maps with no material skyparms) or Material::isSky (everything else)
 		Sky    = 1<<0,
 
-		Skybox = 1<<1
+		Skybox = 1<<1,
+
+		/// @brief DrawCall::bounds is valid.
+		HasBounds = 1<<2
 	};
 };
 
@@ -202,6 +220,10 @@ struct DrawCall
 		uint32_t nIndices = 0;
 	};
 
+	/// @brief World space bounds. Only valid with DrawCallFlags::HasBounds.
+	/// @remarks Used to cull shadow casters against sun shadow cascades.
+	Bounds bounds;
+
 	bool dynamicLighting = true;
 	const Entity *entity = nullptr;
 	int flags = DrawCallFlags::None;
@@ -209,7 +231,6 @@ struct DrawCall
 	IndexBuffer ib;
 	Material *material = nullptr;
 	mat4 modelMatrix = mat4::identity;
-	int skyboxSide;
 	float softSpriteDepth = 0;
 	uint8_t sort = 0;
 	uint64_t state = BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A;
@@ -247,11 +268,11 @@ struct DynamicLight
 
 /*
 Cells texture:
-uint16_t offset into indices texture
+uint32_t offset into indices texture
 
 Indices texture:
-uint8_t num lights
-uint8_t light index (0...n) into lights texture
+uint16_t num lights
+uint16_t light index (0...n) into lights texture
 
 Lights texture:
 DynamicLight struct (0...n)
@@ -268,26 +289,132 @@ public:
 	bgfx::TextureHandle getIndicesTexture() const { return indicesTexture_; }
 	bgfx::TextureHandle getLightsTexture() const { return lightsTexture_; }
 	void initializeGrid();
-	void updateTextures(uint32_t frameNo);
-	void updateUniforms(Uniforms *uniforms);
 
-	static const size_t maxLights = 256;
+	/// @brief Assign lights to the world grid, and to view space clusters for the scene camera if r_dynamicLightClusters is enabled.
+	void updateTextures(uint32_t frameNo, vec3 cameraPosition, const mat3 &cameraRotation, vec2 fov);
+
+	/// @param useClusters Use the view space clusters. Only valid for the camera passed to updateTextures.
+	void updateUniforms(Uniforms *uniforms, bool useClusters);
+
+	/// @brief Time light assignment for increasing numbers of random lights in the loaded world.
+	/// @remarks Clears the current lights.
+	void benchmark(uint32_t frameNo);
+
+	static const size_t maxLights = 4096;
 
 private:
-	void decodeAssignedLight(uint32_t value, vec3b *cellPosition, uint8_t *lightIndex) const;
-	uint32_t encodeAssignedLight(vec3b cellPosition, uint8_t lightIndex) const;
+	/// @brief A worker thread that assigns a range of lights to cells.
+	struct AssignWorker
+	{
+		DynamicLightManager *manager;
+		SDL_Thread *thread = nullptr;
+		SDL_sem *start = nullptr;
+		uint16_t firstLight = 0, lastLight = 0;
+		std::vector<uint32_t> assignedLights;
+	};
+
+	static int AssignWorkerThread(void *data);
+
+	/// @brief Fill assignedLights_, sorted by cell, using the worker threads if there are enough lights.
+	void assign(uint32_t buffer, vec3 cameraPosition, const mat3 &cameraRotation, vec2 fov, bool useClusters);
+
+	/// @remarks Called from worker threads. Reads assignParams_, writes only to assignedLights.
+	void assignLights(uint16_t firstLight, uint16_t lastLight, std::vector<uint32_t> *assignedLights) const;
+
+	void assignLightsToGrid(uint16_t firstLight, uint16_t lastLight, std::vector<uint32_t> *assignedLights) const;
+	void assignLightsToClusters(uint16_t firstLight, uint16_t lastLight, std::vector<uint32_t> *assignedLights) const;
+	size_t clusterSliceFromDepth(float depth) const;
+	float clusterSliceNearDepth(size_t slice) const;
+	void decodeAssignedLight(uint32_t value, size_t *cellIndex, uint16_t *lightIndex) const;
+	void printStats() const;
+	uint32_t encodeAssignedLight(size_t cellIndex, uint16_t lightIndex) const;
 
 	size_t cellIndexFromCellPosition(vec3b position) const;
 
 	/// @remarks Result is clamped.
 	vec3b cellPositionFromWorldspacePosition(vec3 position) const;
 
+	/// @name View space clusters
+	/// @{
+	static const size_t nClusterTilesX = 16;
+	static const size_t nClusterTilesY = 8;
+	static const size_t nClusterSlices = 24;
+	static const size_t nClusters = nClusterTilesX * nClusterTilesY * nClusterSlices;
+
+	/// Everything closer than this is in the first slice.
+	const float clusterNear_ = 16.0f;
+
+	float clusterFar_ = 0;
+	bool clustersValid_ = false;
+	/// @}
+
+	/// @name Light assignment
+	/// @{
+
+	/// @brief Per-update inputs shared with the worker threads.
+	struct AssignParams
+	{
+		uint32_t buffer;
+		vec3 cameraPosition;
+		mat3 cameraRotation;
+
+		/// Tile edges scaled by tan(fov / 2). Padded so four tiles can be read from any tile.
+		float tileEdgesX[nClusterTilesX + 4];
+		float tileEdgesY[nClusterTilesY + 1];
+	};
+
+	AssignParams assignParams_;
+	std::vector<std::unique_ptr<AssignWorker>> workers_;
+	SDL_sem *workersDone_ = nullptr;
+	SDL_atomic_t workersQuit_;
+
+	/// Scratch space for sorting assignedLights_.
+	std::vector<uint32_t> assignedLightsTemp_;
+	/// @}
+
+	/// @brief A half-open range of cells texture texels.
+	struct CellRange
+	{
+		size_t first = SIZE_MAX;
+		size_t last = 0;
+
+		bool isEmpty() const { return first >= last; }
+		void add(size_t cellIndex) { first = std::min(first, cellIndex); last = std::max(last, cellIndex + 1); }
+		void add(const CellRange &range) { if (!range.isEmpty()) { first = std::min(first, range.first); last = std::max(last, range.last); } }
+	};
+
 	bgfx::TextureHandle cellsTexture_;
-	std::vector<uint16_t> cellsTextureData_[BGFX_NUM_BUFFER_FRAMES];
+	std::vector<uint32_t> cellsTextureData_[BGFX_NUM_BUFFER_FRAMES];
 	uint16_t cellsTextureSize_;
 
+	/// @name Incremental uploads
+	/// @{
+
+	/// Non-zero cells in each buffer, cleared when the buffer is reused.
+	CellRange dirtyCells_[BGFX_NUM_BUFFER_FRAMES];
+
+	/// Non-zero cells in the GPU texture.
+	CellRange uploadedCells_;
+
+	/// The light set and camera the textures were last built from.
+	DynamicLight uploadedLights_[maxLights];
+	uint16_t nUploadedLights_ = 0;
+	vec3 uploadedCameraPosition_;
+	mat3 uploadedCameraRotation_;
+	vec2 uploadedCameraFov_;
+
+	/// False until the first full upload after initializeGrid.
+	bool texturesValid_ = false;
+
+	/// Bytes uploaded to the textures by the last updateTextures call. Printed with r_debug 2.
+	uint32_t uploadedBytes_ = 0;
+	/// @}
+
+	/// World grid cells come first in the cells texture, followed by the clusters.
+	size_t nGridCells_;
+
 	bgfx::TextureHandle indicesTexture_;
-	std::vector<uint8_t> indicesTextureData_[BGFX_NUM_BUFFER_FRAMES];
+	std::vector<uint16_t> indicesTextureData_[BGFX_NUM_BUFFER_FRAMES];
 	uint16_t indicesTextureSize_;
 
 	std::vector<uint32_t> assignedLights_;
@@ -295,7 +422,8 @@ private:
 	vec3 gridOffset_;
 	vec3b gridSize_;
 	DynamicLight lights_[BGFX_NUM_BUFFER_FRAMES][maxLights];
-	uint8_t nLights_;
+	uint16_t nLights_;
+	bool hitMaxLights_ = false;
 	bgfx::TextureHandle lightsTexture_;
 	uint16_t lightsTextureSize_;
 };
@@ -411,6 +539,14 @@ struct CreateImageFlags
 };
 
 Image CreateImage(int width, int height, int nComponents, uint8_t *data, int flags = 0);
+
+/// @brief Create a new image from the mips of image that are no larger than maxSize.
+/// @param image An image without mipmaps, e.g. from LoadImage without CreateImageFlags::GenerateMipmaps.
+/// @param flags The CreateImageFlags the full image will be finalized with.
+Image CreateLowMipImage(const Image &image, int flags, int maxSize);
+
+/// @brief Apply CreateImageFlags to an image, e.g. generate mipmaps. Thread safe.
+void FinalizeImage(Image *image, int flags);
 Image LoadImage(const char *filename, int flags = 0);
 
 struct IndexBuffer
@@ -445,10 +581,16 @@ namespace main
 	void DrawStretchPicGradient(float x, float y, float w, float h, float s1, float t1, float s2, float t2, int materialIndex, vec4 gradientColor);
 	void DrawStretchRaw(int x, int y, int w, int h, int cols, int rows, const uint8_t *data, int client, bool dirty);
 	void EndFrame();
+	void EndRegistration();
 	const Entity *GetCurrentEntity();
 	float GetFloatTime();
 	Transform GetMainCameraTransform();
 	void Initialize();
+
+	/// @brief Rebuild the cached static shadow map next frame.
+	/// @remarks Call when something changes which world surfaces are static shadow casters, e.g. material remapping.
+	void InvalidateStaticShadows();
+
 	bool IsCameraMirrored();
 	bool IsLerpTextureAnimationEnabled();
 	bool IsMaxAnisotropyEnabled();
@@ -704,6 +846,9 @@ enum class MaterialTexCoordGen
 	/// S and T from world coordinates.
 	Vector = TCGEN_VECTOR,
 
+	/// Sky cloud layer. Calculated per fragment from the view direction.
+	SkyCloud = TCGEN_SKY_CLOUD,
+
 	/// Clear to 0,0
 	Identity
 };
@@ -832,6 +977,10 @@ struct MaterialStage
 
 	vec4 getFogColorMask() const;
 	uint64_t getState() const;
+
+	/// @brief The diffuse bundle tcGen. Sky material stages are always cloud layers.
+	MaterialTexCoordGen getTexCoordGen() const;
+
 	void setShaderUniforms(Uniforms_MaterialStage *uniforms, int flags = MaterialStageSetUniformsFlags::All) const;
 	void setTextureSamplers(Uniforms_MaterialStage *uniforms) const;
 
@@ -920,6 +1069,10 @@ public:
 	static const size_t maxStages = 8;
 	MaterialStage stages[maxStages];
 
+	/// @brief The first active stage that uses alpha testing, or nullptr if there isn't one.
+	/// @remarks Set by finish, so depth-only passes don't have to search the stages for every draw call.
+	const MaterialStage *alphaTestStage = nullptr;
+
 	float clampTime = 0;                                  // time this shader is clamped to
 	float timeOffset = 0;                                 // current time offset for this shader
 
@@ -968,6 +1121,11 @@ public:
 	float setTime(float time);
 
 	bool hasAutoSpriteDeform() const;
+
+	/// @brief Raise the streaming priority of all textures used by this material.
+	/// @param priority The approximate fraction of the screen covered by the surfaces using this material.
+	void setTextureStreamingPriority(float priority) const;
+
 	void doAutoSpriteDeform(const mat3 &sceneRotation, Vertex *vertices, uint32_t nVertices, uint16_t *indices, uint32_t nIndices, float *softSpriteDepth) const;
 	void setDeformUniforms(Uniforms_Material *uniforms) const;
 
@@ -981,6 +1139,7 @@ class MaterialCache
 {
 public:
 	MaterialCache();
+	~MaterialCache();
 	Material *createMaterial(const Material &base);
 	Material *findMaterial(const char *name, int lightmapIndex = MaterialLightmapId::StretchPic, bool mipRawImage = true);
 	void remapMaterial(const char *oldName, const char *newName, const char *offsetTime);
@@ -992,13 +1151,60 @@ public:
 	Skin *getSkin(qhandle_t handle);
 
 private:
+	/// A shader name in the combined shader text.
+	struct ShaderTextEntry
+	{
+		/// Offset of the shader name in shaderText_.
+		uint32_t offset;
+
+		/// generateHash of the shader name, with textHashTableSize_.
+		uint32_t hash;
+	};
+
+	/// A shader file being validated and scanned for shader names.
+	struct ShaderFile
+	{
+		char filename[MAX_QPATH];
+
+		/// The file contents. Truncated at the first invalid shader, then compressed in place.
+		char *text = nullptr;
+
+		/// Length of the compressed text.
+		int textLength = 0;
+
+		long fileLength = 0;
+
+		/// Offsets are relative to text.
+		std::vector<ShaderTextEntry> entries;
+
+		/// Set if the file contains an invalid shader. Printed after scanning, since it happens on a worker thread.
+		char warning[MAX_TOKEN_CHARS];
+	};
+
 	size_t generateHash(const char *fname, size_t size);
 
+	/// @brief Add or remove texture cache references to all the textures a material uses.
+	void referenceTextures(const Material &material, bool add);
+
 	void createInternalShaders();
 
+	/// Do a simple check on the shader structure in a file, compress the text and extract the shader names.
+	/// @remarks Called on worker threads.
+	void scanShaderFile(ShaderFile *file);
+
 	/// Finds and loads all .shader files, combining them into a single large text block that can be scanned for shader names.
 	void scanAndLoadShaderFiles();
 
+	/// @brief Load the combined shader text and shader name offsets from the shader cache file.
+	/// @param key Identifies the set of shader files. The cache file is rejected if its key doesn't match.
+	/// @return false if the cache file doesn't exist, is out of date or is invalid.
+	bool readShaderTextCache(uint32_t key, std::vector<ShaderTextEntry> *entries);
+
+	void writeShaderTextCache(uint32_t key, const std::vector<ShaderTextEntry> &entries) const;
+
+	/// Create textHashTable_ from the shader names in shaderText_. Entries are in shaderText_ order, so the first definition of a shader wins.
+	void createTextHashTable(const std::vector<ShaderTextEntry> &entries);
+
 	void createExternalShaders();
 
 	/// Scans the combined text description of all the shader files for the given shader name.
@@ -1008,6 +1214,12 @@ private:
 	static const size_t maxShaderFiles_ = 4096;
 	std::vector<char> shaderText_;
 
+	/// @remarks .dat so the file can be read when connected to a pure server.
+	static const char *shaderTextCacheFilename_;
+
+	/// @remarks Increment when the shader cache file format, Compress or generateHash change.
+	static const uint32_t shaderTextCacheVersion_ = 2;
+
 	std::vector<std::unique_ptr<Material>> materials_;
 
 	static const size_t hashTableSize_ = 1024;
@@ -1127,6 +1339,13 @@ struct Patch
 Patch *Patch_Subdivide(int width, int height, const Vertex *points);
 void Patch_Free(Patch *grid);
 
+/// @brief Create relative indices for the grid rows and columns with a LOD error no greater than maxError.
+/// @return false if no rows or columns are removed, i.e. the indices would be the same as Patch::indexes.
+bool Patch_CreateLodIndices(const Patch *grid, float maxError, std::vector<uint16_t> *indexes);
+
+/// @brief Give points shared by patches in the same LOD group the same LOD error, so they don't crack when they change LOD.
+void Patch_FixSharedVertexLodError(const std::vector<Patch *> &grids);
+
 #ifdef USE_PROFILER
 namespace profiler
 {
@@ -1257,10 +1476,8 @@ struct SkySurface
 	std::vector<Vertex> vertices;
 };
 
-/// @remarks Called when a sky material is parsed.
-void Sky_InitializeTexCoords(float heightCloud);
-
-void Sky_Render(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, const SkySurface &surface);
+/// @brief Add skybox and cloud layer draw calls for the visible sky surface triangles.
+void Sky_Render(DrawCallList *drawCallList, const SkySurface &surface);
 
 struct StaticLightFlags
 {
@@ -1320,7 +1537,22 @@ public:
 	int getWidth() const { return width_; }
 	int getHeight() const { return height_; }
 
+	/// @brief Estimated GPU memory used by the texture, including mipmaps.
+	uint32_t calculateSize() const;
+
 private:
+	enum class Lifetime
+	{
+		/// Created by the texture cache. Destroyed with it.
+		Permanent,
+
+		/// Created by the renderer, e.g. lightmaps. Destroyed at the next registration.
+		Session,
+
+		/// Loaded from a file. Evicted when unreferenced and the texture memory budget is exceeded.
+		Cached
+	};
+
 	void initialize(const char *name, const Image &image, int flags, bgfx::TextureFormat::Enum format);
 	void initialize(const char *name, bgfx::TextureHandle handle);
 	uint32_t calculateBgfxFlags() const;
@@ -1333,6 +1565,30 @@ private:
 	bgfx::TextureHandle handle_;
 	Texture *next_;
 
+	/// @name Residency
+	/// @{
+	Lifetime lifetime_;
+
+	/// Number of materials using this texture.
+	int refCount_;
+
+	/// The most recent registration this texture was referenced in. Used to evict the least recently used textures first.
+	uint32_t lastRegistration_;
+	/// @}
+
+	/// @name Streaming
+	/// @{
+
+	/// @brief Replace the texture contents with a new image, e.g. the full resolution mips of a streamed texture.
+	void replace(const Image &image);
+
+	/// Only the low resolution mips have been uploaded.
+	bool isStreaming_;
+
+	/// Largest screen coverage of the surfaces using this texture. Higher priority textures are streamed first.
+	float streamingPriority_;
+	/// @}
+
 	friend class TextureCache;
 };
 
@@ -1356,13 +1612,111 @@ public:
 	Texture *getScratch(size_t index) { return scratchTextures_[index]; }
 	void alias(Texture *from, Texture *to);
 
+	/// @name Residency
+	/// @{
+
+	/// @brief Called when a material starts using a texture.
+	void addReference(const Texture *texture);
+
+	/// @brief Called when a material using a texture is destroyed.
+	void removeReference(const Texture *texture);
+
+	/// @brief Called at BeginRegistration when the texture cache is kept between renderer restarts. Destroys session textures and evicts unreferenced textures.
+	void beginRegistration();
+
+	/// @brief Called at EndRegistration. Evicts unreferenced textures.
+	void endRegistration();
+
+	void printTextures() const;
+
+	/// @brief Whether textures created by this cache are still valid with the current settings, e.g. r_picmip.
+	bool isCompatible() const;
+
+	/// @}
+
+	/// @name Streaming
+	/// @{
+
+	bool isStreaming() const { return streamingEnabled_; }
+
+	/// @brief Raise the priority of a texture that is still waiting for its full resolution mips.
+	void setStreamingPriority(const Texture *texture, float priority);
+
+	/// @brief Called once per frame. Uploads streamed textures with their mips generated, and starts generating mips for the highest priority textures.
+	void updateStreaming();
+
+	/// @}
+
 private:
 	void hashTexture(Texture *texture);
+	void unhashTexture(Texture *texture);
 	size_t generateHash(const char *name) const;
 
+	/// @brief Get a free texture slot, evicting an unreferenced texture if there are none.
+	Texture *allocateTexture();
+
+	void destroyTexture(Texture *texture);
+
+	/// @brief Evict unreferenced cached textures, least recently used first, until the total texture size is within the r_textureMemory budget.
+	void evictTextures();
+
+	/// @name Streaming
+	/// @{
+
+	struct StreamingTexture
+	{
+		Texture *texture;
+
+		/// Full resolution image. No mipmaps until generated by the streaming thread.
+		Image image;
+
+		/// CreateImageFlags to finalize the image with.
+		int imageFlags;
+	};
+
+	/// @brief Load an image and create a texture with only its low resolution mips. The rest are generated and uploaded later by updateStreaming.
+	Texture *createStreaming(const char *name, int flags, int imageFlags);
+
+	void cancelStreaming(Texture *texture);
+	void waitForStreamingThread();
+	static int StreamingThread(void *data);
+
+	/// Mipmaps larger than this are streamed.
+	static const int streamingLowMipSize_ = 64;
+
+	/// Maximum number of textures to generate mipmaps for in one streaming thread batch. Keeps the batch responsive to priority changes.
+	static const size_t maxStreamingBatchSize_ = 16;
+
+	/// Maximum amount of streamed texture data to upload per frame.
+	static const uint32_t streamingUploadBudget_ = 8 * 1024 * 1024;
+
+	bool streamingEnabled_;
+
+	/// Waiting for mipmaps to be generated.
+	std::vector<StreamingTexture> pendingStreamingTextures_;
+
+	/// Owned by the streaming thread while it is running.
+	std::vector<StreamingTexture> streamingBatch_;
+
+	/// Mipmaps generated, waiting to be uploaded.
+	std::vector<StreamingTexture> streamedTextures_;
+
+	SDL_Thread *streamingThread_ = nullptr;
+	SDL_atomic_t streamingThreadDone_;
+	/// @}
+
 	static const size_t maxTextures_ = 2048;
 	Texture textures_[maxTextures_];
 	size_t nTextures_ = 0;
+	std::vector<Texture *> freeTextures_;
+	uint32_t registration_ = 0;
+
+	/// @name Settings the textures were created with
+	/// @{
+	int picmip_;
+	float identityLight_;
+	bool maxAnisotropyEnabled_;
+	/// @}
 	static const size_t hashTableSize_ = 1024;
 	Texture *hashTable_[hashTableSize_];
 	static const int defaultImageSize_ = 16;
@@ -1394,7 +1748,10 @@ struct TextureUnit
 		DynamicLightIndices = TU_DYNAMIC_LIGHT_INDICES,
 		DynamicLights       = TU_DYNAMIC_LIGHTS,
 		ShadowMap           = TU_SHADOWMAP,
-		Noise               = TU_NOISE
+		Noise               = TU_NOISE,
+
+		/// @remarks The skybox shader uses this and the next 5 units, one per side.
+		Skybox              = TU_SKYBOX
 	};
 };
 
@@ -1425,6 +1782,9 @@ struct Uniform_vec4
 	bgfx::UniformHandle handle;
 };
 
+/// @remarks Must match u_ShadowCascadeScaleOffset in SunLight.sh.
+static const uint16_t g_maxShadowCascades = 4;
+
 struct Uniforms
 {
 	/// @remarks Only x used.
@@ -1470,9 +1830,15 @@ struct Uniforms
 	/// @remarks w not used.
 	Uniform_vec4 dynamicLightGridOffset = "u_DynamicLightGridOffset";
 
-	/// @remarks w not used.
+	/// @remarks w is 1 if the camera uses view space clusters instead of the world space grid.
 	Uniform_vec4 dynamicLightGridSize = "u_DynamicLightGridSize";
 
+	/// @remarks xy is the number of screen tiles, z the number of depth slices, w the offset of the first cluster in the cells texture.
+	Uniform_vec4 dynamicLightClusterSize = "u_DynamicLightClusterSize";
+
+	/// @remarks x is the depth that exponential slicing starts from, y is slices / log(far / near). zw not used.
+	Uniform_vec4 dynamicLightClusterDepth = "u_DynamicLightClusterDepth";
+
 	/// @remarks x is the number of dynamic lights, y is the intensity scale.
 	Uniform_vec4 dynamicLight_Num_Intensity = "u_DynamicLight_Num_Intensity";
 
@@ -1485,9 +1851,11 @@ struct Uniforms
 	/// @{
 
 	/// @brief Enable fog in the generic shader.
-	/// @remarks Only x used.
+	/// @remarks x enables adjusting vertex colors for fog, y enables blending the fragment with fogColor. z and w not used.
 	Uniform_vec4 fogEnabled = "u_FogEnabled";
 
+	Uniform_vec4 fogColor = "u_FogColor";
+
 	Uniform_vec4 fogDistance = "u_FogDistance";
 	Uniform_vec4 fogDepth = "u_FogDepth";
 
@@ -1506,6 +1874,8 @@ struct Uniforms
 	/// @name Sun light
 	/// @{
 	Uniform_mat4 lightModelViewProj = "u_LightModelViewProj";
+	Uniform_vec4 shadowCascadeSplits = "u_ShadowCascadeSplits";
+	Uniform_vec4 shadowCascadeScaleOffset = { "u_ShadowCascadeScaleOffset", g_maxShadowCascades };
 	Uniform_vec4 shadowMap_TexelSize_DepthBias_NormalBias_SlopeScaleDepthBias = "u_ShadowMap_TexelSize_DepthBias_NormalBias_SlopeScaleDepthBias";
 	Uniform_vec4 sunLightColor = "u_SunLightColor";
 	Uniform_vec4 sunLightDir = "u_SunLightDir";
@@ -1576,6 +1946,9 @@ struct Uniforms_MaterialStage
 	Uniform_sampler dynamicLightIndicesSampler = "u_DynamicLightIndicesSampler";
 	Uniform_sampler dynamicLightsSampler = "u_DynamicLightsSampler";
 	Uniform_sampler lightSampler = "u_LightSampler";
+
+	/// @remarks In TextureUnit::Skybox order. +x, -x, +y, -y, +z, -z.
+	Uniform_sampler skyboxSamplers[6] = { "u_SkyboxSampler0", "u_SkyboxSampler1", "u_SkyboxSampler2", "u_SkyboxSampler3", "u_SkyboxSampler4", "u_SkyboxSampler5" };
 	/// @}
 
 	Uniform_vec4 color = "u_Color";
@@ -1603,6 +1976,8 @@ struct Uniforms_MaterialStage
 
 	/// @name tcgen
 	/// @{
+
+	/// @remarks x is the cloud height with MaterialTexCoordGen::SkyCloud.
 	Uniform_vec4 tcGenVector0 = "u_TCGen0Vector0";
 	Uniform_vec4 tcGenVector1 = "u_TCGen0Vector1";
 	/// @}
@@ -1645,13 +2020,35 @@ namespace util
 
 	/// @}
 
+	/// @brief Call func once for each index in [0, count), spread over worker threads. Blocks until every call has returned.
+	/// @remarks func must not call interface functions, they aren't thread safe. Parsing functions are safe, parse state is per thread.
+	void ParallelFor(size_t count, const std::function<void(size_t)> &func);
+
 	uint16_t CalculateSmallestPowerOfTwoTextureSize(int nPixels);
 
 	/// @brief Given a triangulated quad, extract the unique corner vertices.
 	std::array<Vertex *, 4> ExtractQuadCorners(Vertex *vertices, const uint16_t *indices);
 
-	bool IsGeometryOffscreen(const mat4 &mvp, const uint16_t *indices, size_t nIndices, const Vertex *vertices);
-	bool IsGeometryBackfacing(vec3 cameraPosition, const uint16_t *indices, size_t nIndices, const Vertex *vertices, float *shortestVertexDistanceSquared = nullptr);
+	/// @remarks indices are offset by firstVertex, i.e. vertices[indices[i] - firstVertex].
+	bool IsGeometryOffscreen(const mat4 &mvp, const uint32_t *indices, size_t nIndices, const Vertex *vertices, uint32_t firstVertex = 0);
+
+	/// @remarks indices are offset by firstVertex, i.e. vertices[indices[i] - firstVertex].
+	bool IsGeometryBackfacing(vec3 cameraPosition, const uint32_t *indices, size_t nIndices, const Vertex *vertices, uint32_t firstVertex = 0, float *shortestVertexDistanceSquared = nullptr);
+
+	/// @name Vertex cache optimization
+	/// @{
+
+	/// @brief Reorder triangles to improve post-transform vertex cache hits, using Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+	/// @remarks Indices are left unchanged if any are out of range.
+	void OptimizeVertexCache(uint16_t *indices, size_t nIndices, size_t nVertices);
+
+	/// @brief Reorder vertices by first use in indices and remap the indices. Unused vertices are moved to the end.
+	void OptimizeVertexFetch(Vertex *vertices, size_t nVertices, uint16_t *indices, size_t nIndices);
+
+	/// @brief The number of post-transform vertex cache misses for indices with a FIFO cache. Divide by the number of triangles to get the ACMR.
+	size_t CalculateVertexCacheMisses(const uint16_t *indices, size_t nIndices, size_t cacheSize = 16);
+
+	/// @}
 
 	vec3 MirroredPoint(const vec3 in, const Transform &surface, const Transform &camera);
 	vec3 MirroredVector(const vec3 in, const Transform &surface, const Transform &camera);
@@ -1714,11 +2111,13 @@ struct Vertex
 		decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
 		decl.add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float);
 		decl.add(bgfx::Attrib::Color0, 4, bgfx::AttribType::Uint8, true);
-		decl.add(bgfx::Attrib::TexCoord0, 4, bgfx::AttribType::Float);
+		decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
+		decl.add(bgfx::Attrib::TexCoord1, 2, bgfx::AttribType::Float);
 		decl.m_stride = sizeof(Vertex);
 		decl.m_offset[bgfx::Attrib::Position] = offsetof(Vertex, pos);
 		decl.m_offset[bgfx::Attrib::Normal] = offsetof(Vertex, normal);
 		decl.m_offset[bgfx::Attrib::TexCoord0] = offsetof(Vertex, texCoord);
+		decl.m_offset[bgfx::Attrib::TexCoord1] = offsetof(Vertex, texCoord) + sizeof(float) * 2;
 		decl.m_offset[bgfx::Attrib::Color0] = offsetof(Vertex, color);
 		decl.end();
 	}
@@ -1726,6 +2125,33 @@ struct Vertex
 	static bgfx::VertexDecl decl;
 };
 
+/// @brief GPU vertex format for static world and model geometry.
+/// @remarks Has the same attributes as Vertex, so the same shaders can be used. Normals and lightmap texture coordinates are normalized 16-bit integers.
+struct CompactVertex
+{
+	vec3 pos;
+	int16_t normal[4]; // w is unused.
+	vec4b color; // Linear space.
+	vec2 texCoord;
+	int16_t lightmapTexCoord[2];
+
+	static void init()
+	{
+		decl.begin();
+		decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
+		decl.add(bgfx::Attrib::Normal, 4, bgfx::AttribType::Int16, true);
+		decl.add(bgfx::Attrib::Color0, 4, bgfx::AttribType::Uint8, true);
+		decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
+		decl.add(bgfx::Attrib::TexCoord1, 2, bgfx::AttribType::Int16, true);
+		decl.end();
+	}
+
+	/// @brief Copy vertices to bgfx memory in the compact format.
+	static const bgfx::Memory *copy(const Vertex *vertices, uint32_t nVertices);
+
+	static bgfx::VertexDecl decl;
+};
+
 struct VertexBuffer
 {
 	VertexBuffer() { handle.idx = bgfx::kInvalidHandle; }
@@ -1740,6 +2166,7 @@ enum class VisibilityId
 	Portal,
 	Probe,
 	Reflection,
+	Shadow, // the whole world, for the static shadow map
 	SkyboxPortal,
 	Num
 };
@@ -1795,6 +2222,7 @@ namespace world
 	void UpdateVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *areaMask);
 	void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRotation);
 	void PickMaterial();
+	void BenchmarkPointQueries();
 }
 
 static const size_t g_funcTableSize = 1024;
@@ -62,6 +62,8 @@ void Texture::initialize(const char *name, bgfx::TextureHandle handle)
 	strcpy(name_, name);
 	handle_ = handle;
 	flags_ = 0;
+	width_ = height_ = 0;
+	nMips_ = 1;
 }
 
 void Texture::resize(int width, int height)
@@ -84,6 +86,29 @@ void Texture::update(const bgfx::Memory *mem, int x, int y, int width, int heigh
 	bgfx::updateTexture2D(handle_, 0, 0, x, y, width, height, mem);
 }
 
+void Texture::replace(const Image &image)
+{
+	bgfx::destroy(handle_);
+	width_ = image.width;
+	height_ = image.height;
+	nMips_ = image.nMips;
+	handle_ = bgfx::createTexture2D(width_, height_, nMips_ > 1, 1, format_, calculateBgfxFlags(), bgfx::makeRef(image.data, image.dataSize, image.release));
+
+#ifdef _DEBUG
+	bgfx::setName(handle_, name_);
+#endif
+}
+
+uint32_t Texture::calculateSize() const
+{
+	if (!bgfx::isValid(handle_) || width_ <= 0 || height_ <= 0)
+		return 0;
+
+	bgfx::TextureInfo info;
+	bgfx::calcTextureSize(info, (uint16_t)width_, (uint16_t)height_, 1, false, nMips_ > 1, 1, format_);
+	return info.storageSize;
+}
+
 uint32_t Texture::calculateBgfxFlags() const
 {
 	uint32_t bgfxFlags = BGFX_TEXTURE_NONE;
@@ -101,8 +126,14 @@ uint32_t Texture::calculateBgfxFlags() const
 	return bgfxFlags;
 }
 
-TextureCache::TextureCache() : hashTable_()
+TextureCache::TextureCache() : hashTable_(), defaultTexture_(nullptr)
 {
+	picmip_ = g_cvars.picmip.getInt();
+	identityLight_ = g_identityLight;
+	maxAnisotropyEnabled_ = main::IsMaxAnisotropyEnabled();
+	streamingEnabled_ = g_cvars.textureStreaming.getBool();
+	SDL_AtomicSet(&streamingThreadDone_, 0);
+
 	// Default texture (black box with white border).
 	memset(defaultImageData_, 32, defaultImageDataSize_);
 
@@ -146,13 +177,33 @@ TextureCache::TextureCache() : hashTable_()
 		memset(scratchImageData_[i], 0, defaultImageDataSize_);
 		scratchTextures_[i] = create("*scratch", CreateImage(defaultImageSize_, defaultImageSize_, 4, scratchImageData_[i]), TextureFlags::Picmip | TextureFlags::ClampToEdge, bgfx::TextureFormat::RGBA8);
 	}
+
+	for (size_t i = 0; i < nTextures_; i++)
+	{
+		textures_[i].lifetime_ = Texture::Lifetime::Permanent;
+	}
 }
 
 TextureCache::~TextureCache()
 {
+	waitForStreamingThread();
+
+	for (StreamingTexture &st : pendingStreamingTextures_)
+	{
+		if (st.image.release)
+			st.image.release(st.image.data, nullptr);
+	}
+
+	for (StreamingTexture &st : streamedTextures_)
+	{
+		if (st.image.release)
+			st.image.release(st.image.data, nullptr);
+	}
+
 	for (size_t i = 0; i < nTextures_; i++)
 	{
-		bgfx::destroy(textures_[i].handle_);
+		if (bgfx::isValid(textures_[i].handle_))
+			bgfx::destroy(textures_[i].handle_);
 	}
 }
 
@@ -163,13 +214,7 @@ Texture *TextureCache::create(const char *name, const Image &image, int flags, b
 		interface::Error("Texture name \"%s\" is too long", name);
 	}
 
-	if (nTextures_ == maxTextures_)
-	{
-		interface::Error("Exceeded max textures");
-	}
-
-	Texture *texture = &textures_[nTextures_];
-	nTextures_++;
+	Texture *texture = allocateTexture();
 	texture->initialize(name, image, flags, format);
 	hashTexture(texture);
 	return texture;
@@ -182,13 +227,7 @@ Texture *TextureCache::create(const char *name, bgfx::TextureHandle handle)
 		interface::Error("Texture name \"%s\" is too long", name);
 	}
 
-	if (nTextures_ == maxTextures_)
-	{
-		interface::Error("Exceeded max textures");
-}
-
-	Texture *texture = &textures_[nTextures_];
-	nTextures_++;
+	Texture *texture = allocateTexture();
 	texture->initialize(name, handle);
 	hashTexture(texture);
 	return texture;
@@ -232,12 +271,25 @@ Texture *TextureCache::find(const char *name, int flags)
 		imageFlags |= CreateImageFlags::Picmip;
 	}
 
-	Image image = LoadImage(name, imageFlags);
+	Texture *texture = nullptr;
 
-	if (!image.data)
+	if (streamingEnabled_ && (imageFlags & CreateImageFlags::GenerateMipmaps) && !(flags & TextureFlags::Mutable))
+	{
+		texture = createStreaming(name, flags, imageFlags);
+	}
+	else
+	{
+		Image image = LoadImage(name, imageFlags);
+
+		if (image.data)
+			texture = create(name, image, flags, bgfx::TextureFormat::RGBA8);
+	}
+
+	if (!texture)
 		return nullptr;
 
-	return create(name, image, flags, bgfx::TextureFormat::RGBA8);
+	texture->lifetime_ = Texture::Lifetime::Cached;
+	return texture;
 }
 
 Texture *TextureCache::get(const char *name)
@@ -272,6 +324,78 @@ void TextureCache::alias(Texture *from, Texture *to)
 	}
 }
 
+void TextureCache::addReference(const Texture *texture)
+{
+	if (!texture)
+		return;
+
+	Texture &t = textures_[texture - textures_];
+	t.refCount_++;
+	t.lastRegistration_ = registration_;
+}
+
+void TextureCache::removeReference(const Texture *texture)
+{
+	if (!texture)
+		return;
+
+	Texture &t = textures_[texture - textures_];
+	assert(t.refCount_ > 0);
+	t.refCount_--;
+}
+
+void TextureCache::beginRegistration()
+{
+	registration_++;
+
+	// Textures created by the renderer for the previous world, e.g. lightmaps, are no longer used.
+	for (size_t i = 0; i < nTextures_; i++)
+	{
+		Texture &t = textures_[i];
+
+		if (bgfx::isValid(t.handle_) && t.lifetime_ == Texture::Lifetime::Session)
+			destroyTexture(&t);
+	}
+
+	evictTextures();
+}
+
+void TextureCache::endRegistration()
+{
+	evictTextures();
+}
+
+bool TextureCache::isCompatible() const
+{
+	return picmip_ == g_cvars.picmip.getInt() && identityLight_ == g_identityLight && maxAnisotropyEnabled_ == main::IsMaxAnisotropyEnabled() && streamingEnabled_ == g_cvars.textureStreaming.getBool();
+}
+
+void TextureCache::printTextures() const
+{
+	uint32_t totalSize = 0, referencedSize = 0;
+	int nResident = 0;
+
+	for (size_t i = 0; i < nTextures_; i++)
+	{
+		const Texture &t = textures_[i];
+
+		if (!bgfx::isValid(t.handle_))
+			continue;
+
+		const char lifetime = t.lifetime_ == Texture::Lifetime::Permanent ? 'p' : (t.lifetime_ == Texture::Lifetime::Session ? 's' : 'c');
+		const uint32_t size = t.calculateSize();
+		interface::Printf("%4d: [%c] %4dx%-4d %3d refs %6u KB %s%s\n", (int)i, lifetime, t.width_, t.height_, t.refCount_, size / 1024, t.name_, t.isStreaming_ ? " (streaming)" : "");
+		nResident++;
+		totalSize += size;
+
+		if (t.refCount_ > 0 || t.lifetime_ != Texture::Lifetime::Cached)
+			referencedSize += size;
+	}
+
+	interface::Printf("%d textures, %u KB total, %u KB referenced\n", nResident, totalSize / 1024, referencedSize / 1024);
+	interface::Printf("[p] permanent, [s] session, [c] cached\n");
+}
+
 void TextureCache::hashTexture(Texture *texture)
 {
 	size_t hash = generateHash(texture->name_);
@@ -279,6 +403,275 @@ void TextureCache::hashTexture(Texture *texture)
 	hashTable_[hash] = texture;
 }
 
+void TextureCache::unhashTexture(Texture *texture)
+{
+	Texture **t = &hashTable_[generateHash(texture->name_)];
+
+	while (*t)
+	{
+		if (*t == texture)
+		{
+			*t = texture->next_;
+			break;
+		}
+
+		t = &(*t)->next_;
+	}
+
+	texture->next_ = nullptr;
+}
+
+Texture *TextureCache::allocateTexture()
+{
+	Texture *texture = nullptr;
+
+	if (!freeTextures_.empty())
+	{
+		texture = freeTextures_.back();
+		freeTextures_.pop_back();
+	}
+	else if (nTextures_ < maxTextures_)
+	{
+		texture = &textures_[nTextures_];
+		nTextures_++;
+	}
+	else
+	{
+		// Out of slots. Evict the least recently used unreferenced texture.
+		Texture *lru = nullptr;
+
+		for (size_t i = 0; i < nTextures_; i++)
+		{
+			Texture &t = textures_[i];
+
+			if (bgfx::isValid(t.handle_) && t.lifetime_ == Texture::Lifetime::Cached && t.refCount_ == 0 && (!lru || t.lastRegistration_ < lru->lastRegistration_))
+				lru = &t;
+		}
+
+		if (!lru)
+		{
+			interface::Error("Exceeded max textures");
+		}
+
+		destroyTexture(lru);
+		texture = freeTextures_.back();
+		freeTextures_.pop_back();
+	}
+
+	// Owned by the current session until find marks it as cached.
+	texture->lifetime_ = Texture::Lifetime::Session;
+	texture->refCount_ = 0;
+	texture->lastRegistration_ = registration_;
+	texture->isStreaming_ = false;
+	texture->streamingPriority_ = 0;
+	return texture;
+}
+
+void TextureCache::destroyTexture(Texture *texture)
+{
+	assert(texture->refCount_ == 0);
+
+	if (texture->isStreaming_)
+		cancelStreaming(texture);
+
+	unhashTexture(texture);
+	aliases_.erase(texture);
+
+	for (auto it = aliases_.begin(); it != aliases_.end();)
+	{
+		if (it->second == texture)
+			it = aliases_.erase(it);
+		else
+			++it;
+	}
+
+	bgfx::destroy(texture->handle_);
+	texture->handle_ = BGFX_INVALID_HANDLE;
+	texture->name_[0] = 0;
+	freeTextures_.push_back(texture);
+}
+
+void TextureCache::evictTextures()
+{
+	const int budget = g_cvars.textureMemory.getInt();
+
+	if (budget <= 0)
+		return;
+
+	const uint64_t budgetSize = uint64_t(budget) * 1024 * 1024;
+	uint64_t totalSize = 0;
+	std::vector<Texture *> candidates;
+
+	for (size_t i = 0; i < nTextures_; i++)
+	{
+		Texture &t = textures_[i];
+
+		if (!bgfx::isValid(t.handle_))
+			continue;
+
+		totalSize += t.calculateSize();
+
+		if (t.lifetime_ == Texture::Lifetime::Cached && t.refCount_ == 0)
+			candidates.push_back(&t);
+	}
+
+	if (totalSize <= budgetSize)
+		return;
+
+	std::sort(candidates.begin(), candidates.end(), [](const Texture *a, const Texture *b) { return a->lastRegistration_ < b->lastRegistration_; });
+	int nEvicted = 0;
+	uint64_t evictedSize = 0;
+
+	for (Texture *t : candidates)
+	{
+		if (totalSize <= budgetSize)
+			break;
+
+		const uint32_t size = t->calculateSize();
+		totalSize -= size;
+		evictedSize += size;
+		nEvicted++;
+		destroyTexture(t);
+	}
+
+	interface::PrintDeveloperf("Evicted %d textures (%u KB)\n", nEvicted, uint32_t(evictedSize / 1024));
+}
+
+void TextureCache::setStreamingPriority(const Texture *texture, float priority)
+{
+	if (!texture || !texture->isStreaming_)
+		return;
+
+	Texture &t = textures_[texture - textures_];
+	t.streamingPriority_ = std::max(t.streamingPriority_, priority);
+}
+
+void TextureCache::updateStreaming()
+{
+	if (!streamingEnabled_)
+		return;
+
+	// Collect the batch if the streaming thread has finished generating mipmaps.
+	if (streamingThread_ && SDL_AtomicGet(&streamingThreadDone_))
+		waitForStreamingThread();
+
+	auto compareStreamingPriority = [](const StreamingTexture &a, const StreamingTexture &b) { return a.texture->streamingPriority_ > b.texture->streamingPriority_; };
+
+	// Upload the highest priority textures first, up to the per frame budget.
+	if (!streamedTextures_.empty())
+	{
+		std::stable_sort(streamedTextures_.begin(), streamedTextures_.end(), compareStreamingPriority);
+		uint32_t uploadedSize = 0;
+		size_t nUploaded = 0;
+
+		while (nUploaded < streamedTextures_.size() && uploadedSize < streamingUploadBudget_)
+		{
+			StreamingTexture &st = streamedTextures_[nUploaded];
+			st.texture->replace(st.image); // Takes ownership of the image data.
+			st.texture->isStreaming_ = false;
+			uploadedSize += st.image.dataSize;
+			nUploaded++;
+		}
+
+		streamedTextures_.erase(streamedTextures_.begin(), streamedTextures_.begin() + nUploaded);
+	}
+
+	// Start generating mipmaps for the next batch.
+	if (!streamingThread_ && !pendingStreamingTextures_.empty())
+	{
+		std::stable_sort(pendingStreamingTextures_.begin(), pendingStreamingTextures_.end(), compareStreamingPriority);
+		const size_t batchSize = std::min(maxStreamingBatchSize_, pendingStreamingTextures_.size());
+		streamingBatch_.assign(pendingStreamingTextures_.begin(), pendingStreamingTextures_.begin() + batchSize);
+		pendingStreamingTextures_.erase(pendingStreamingTextures_.begin(), pendingStreamingTextures_.begin() + batchSize);
+		SDL_AtomicSet(&streamingThreadDone_, 0);
+		streamingThread_ = SDL_CreateThread(StreamingThread, "TextureStreaming", this);
+
+		if (!streamingThread_)
+		{
+			// Generate the mipmaps on this thread instead.
+			StreamingThread(this);
+			waitForStreamingThread();
+		}
+	}
+}
+
+Texture *TextureCache::createStreaming(const char *name, int flags, int imageFlags)
+{
+	// Don't generate mipmaps yet, that's done by the streaming thread.
+	Image image = LoadImage(name);
+
+	if (!image.data)
+		return nullptr;
+
+	if (image.width <= streamingLowMipSize_ && image.height <= streamingLowMipSize_)
+	{
+		// Small enough to not bother streaming.
+		FinalizeImage(&image, imageFlags);
+		return create(name, image, flags, bgfx::TextureFormat::RGBA8);
+	}
+
+	Texture *texture = create(name, CreateLowMipImage(image, imageFlags, streamingLowMipSize_), flags, bgfx::TextureFormat::RGBA8);
+	texture->isStreaming_ = true;
+	StreamingTexture st;
+	st.texture = texture;
+	st.image = image;
+	st.imageFlags = imageFlags;
+	pendingStreamingTextures_.push_back(st);
+	return texture;
+}
+
+void TextureCache::cancelStreaming(Texture *texture)
+{
+	auto release = [texture](std::vector<StreamingTexture> &textures)
+	{
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+		{
+			if (it->texture == texture)
+			{
+				if (it->image.release)
+					it->image.release(it->image.data, nullptr);
+
+				textures.erase(it);
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	if (!release(pendingStreamingTextures_) && !release(streamedTextures_))
+	{
+		// Must be in the streaming thread batch.
+		waitForStreamingThread();
+		release(streamedTextures_);
+	}
+
+	texture->isStreaming_ = false;
+}
+
+void TextureCache::waitForStreamingThread()
+{
+	if (streamingThread_)
+	{
+		SDL_WaitThread(streamingThread_, nullptr);
+		streamingThread_ = nullptr;
+	}
+
+	streamedTextures_.insert(streamedTextures_.end(), streamingBatch_.begin(), streamingBatch_.end());
+	streamingBatch_.clear();
+}
+
+int TextureCache::StreamingThread(void *data)
+{
+	auto cache = (TextureCache *)data;
+
+	for (StreamingTexture &st : cache->streamingBatch_)
+		FinalizeImage(&st.image, st.imageFlags);
+
+	SDL_AtomicSet(&cache->streamingThreadDone_, 1);
+	return 0;
+}
+
 size_t TextureCache::generateHash(const char *name) const
 {
 	size_t hash = 0, i = 0;
@@ -25,10 +25,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 namespace renderer {
 namespace util {
 
-static	char	com_token[MAX_TOKEN_CHARS];
-static	char	com_parsename[MAX_TOKEN_CHARS];
-static	int		com_lines;
-static	int		com_tokenline;
+// Per thread, so files can be parsed in parallel.
+static	thread_local char	com_token[MAX_TOKEN_CHARS];
+static	thread_local char	com_parsename[MAX_TOKEN_CHARS];
+static	thread_local int	com_lines;
+static	thread_local int	com_tokenline;
 
 static char *SkipWhitespace(char *data, bool *hasNewLines)
 {
@@ -290,6 +291,56 @@ int Compress(char *data_p)
 	return int(out - data_p);
 }
 
+struct ParallelForData
+{
+	SDL_atomic_t nextIndex;
+	size_t count;
+	const std::function<void(size_t)> *func;
+};
+
+static int ParallelForThread(void *data)
+{
+	auto pfd = (ParallelForData *)data;
+
+	for (;;)
+	{
+		const size_t index = (size_t)SDL_AtomicAdd(&pfd->nextIndex, 1);
+
+		if (index >= pfd->count)
+			break;
+
+		(*pfd->func)(index);
+	}
+
+	return 0;
+}
+
+void ParallelFor(size_t count, const std::function<void(size_t)> &func)
+{
+	static const int maxThreads = 32;
+	const int nThreads = std::min(std::min(SDL_GetCPUCount(), maxThreads), (int)count);
+	ParallelForData pfd;
+	SDL_AtomicSet(&pfd.nextIndex, 0);
+	pfd.count = count;
+	pfd.func = &func;
+	SDL_Thread *threads[maxThreads];
+	int nCreatedThreads = 0;
+
+	// The calling thread is one of the workers.
+	for (int i = 1; i < nThreads; i++)
+	{
+		threads[nCreatedThreads] = SDL_CreateThread(ParallelForThread, "ParallelFor", &pfd);
+
+		if (threads[nCreatedThreads])
+			nCreatedThreads++;
+	}
+
+	ParallelForThread(&pfd);
+
+	for (int i = 0; i < nCreatedThreads; i++)
+		SDL_WaitThread(threads[i], nullptr);
+}
+
 uint16_t CalculateSmallestPowerOfTwoTextureSize(int nPixels)
 {
 	const int sr = (int)ceil(sqrtf((float)nPixels));
@@ -319,14 +370,14 @@ std::array<Vertex *, 4> ExtractQuadCorners(Vertex *vertices, const uint16_t *ind
 	return corners;
 }
 
-bool IsGeometryOffscreen(const mat4 &mvp, const uint16_t *indices, size_t nIndices, const Vertex *vertices)
+bool IsGeometryOffscreen(const mat4 &mvp, const uint32_t *indices, size_t nIndices, const Vertex *vertices, uint32_t firstVertex)
 {
 	uint32_t pointAnd = (uint32_t)~0;
 
 	for (size_t j = 0; j < nIndices; j++)
 	{
 		uint32_t pointFlags = 0;
-		const vec4 clip = mvp.transform(vec4(vertices[indices[j]].pos, 1));
+		const vec4 clip = mvp.transform(vec4(vertices[indices[j] - firstVertex].pos, 1));
 
 		for (size_t k = 0; k < 3; k++)
 		{
@@ -346,7 +397,7 @@ bool IsGeometryOffscreen(const mat4 &mvp, const uint16_t *indices, size_t nIndic
 	return pointAnd != 0;
 }
 
-bool IsGeometryBackfacing(vec3 cameraPosition, const uint16_t *indices, size_t nIndices, const Vertex *vertices, float *shortestVertexDistanceSquared)
+bool IsGeometryBackfacing(vec3 cameraPosition, const uint32_t *indices, size_t nIndices, const Vertex *vertices, uint32_t firstVertex, float *shortestVertexDistanceSquared)
 {
 	size_t nTriangles = nIndices / 3;
 
@@ -355,7 +406,7 @@ bool IsGeometryBackfacing(vec3 cameraPosition, const uint16_t *indices, size_t n
 
 	for (size_t i = 0; i < nIndices; i += 3)
 	{
-		const Vertex &vertex = vertices[indices[i]];
+		const Vertex &vertex = vertices[indices[i] - firstVertex];
 		const vec3 normal = vertex.pos - cameraPosition;
 		const float length = normal.lengthSquared(); // lose the sqrt
 
@@ -369,6 +420,249 @@ bool IsGeometryBackfacing(vec3 cameraPosition, const uint16_t *indices, size_t n
 	return nTriangles == 0;
 }
 
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+static const int s_vertexCacheSize = 32;
+
+static float CalculateVertexScore(int cachePosition, int nActiveTriangles)
+{
+	// No triangles left using this vertex.
+	if (nActiveTriangles == 0)
+		return -1.0f;
+
+	float score = 0;
+
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			// The vertex was used in the last triangle. Fixed score so it isn't favored over other vertices in the cache.
+			score = 0.75f;
+		}
+		else
+		{
+			// Points for being high in the cache.
+			const float scaler = 1.0f / (s_vertexCacheSize - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, 1.5f);
+		}
+	}
+
+	// Bonus points for having a low number of triangles left, so lone vertices are cleared up.
+	return score + 2.0f * powf((float)nActiveTriangles, -0.5f);
+}
+
+void OptimizeVertexCache(uint16_t *indices, size_t nIndices, size_t nVertices)
+{
+	assert(indices);
+	const size_t nTriangles = nIndices / 3;
+
+	if (nTriangles < 2)
+		return;
+
+	for (size_t i = 0; i < nTriangles * 3; i++)
+	{
+		if (indices[i] >= nVertices)
+			return;
+	}
+
+	// Build vertex to triangle adjacency.
+	std::vector<int> nActiveTriangles(nVertices, 0);
+
+	for (size_t i = 0; i < nTriangles * 3; i++)
+		nActiveTriangles[indices[i]]++;
+
+	std::vector<size_t> firstAdjacency(nVertices + 1, 0);
+
+	for (size_t i = 0; i < nVertices; i++)
+		firstAdjacency[i + 1] = firstAdjacency[i] + nActiveTriangles[i];
+
+	std::vector<int> adjacency(nTriangles * 3);
+	std::vector<int> nAdjacent(nVertices, 0);
+
+	for (size_t i = 0; i < nTriangles * 3; i++)
+	{
+		const uint16_t v = indices[i];
+		adjacency[firstAdjacency[v] + nAdjacent[v]++] = int(i / 3);
+	}
+
+	// Initial scores.
+	std::vector<int> cachePosition(nVertices, -1);
+	std::vector<float> vertexScore(nVertices);
+
+	for (size_t i = 0; i < nVertices; i++)
+		vertexScore[i] = CalculateVertexScore(-1, nActiveTriangles[i]);
+
+	std::vector<float> triangleScore(nTriangles);
+	std::vector<bool> triangleAdded(nTriangles, false);
+
+	for (size_t i = 0; i < nTriangles; i++)
+		triangleScore[i] = vertexScore[indices[i * 3 + 0]] + vertexScore[indices[i * 3 + 1]] + vertexScore[indices[i * 3 + 2]];
+
+	std::vector<uint16_t> output(nTriangles * 3);
+	int cache[s_vertexCacheSize + 3];
+	int cacheCount = 0;
+	int bestTriangle = -1;
+	size_t nextUnadded = 0;
+
+	for (size_t t = 0; t < nTriangles; t++)
+	{
+		if (bestTriangle < 0)
+		{
+			// Nothing in the cache uses a remaining triangle. Fall back to a linear search.
+			float bestScore = -1;
+
+			for (size_t i = nextUnadded; i < nTriangles; i++)
+			{
+				if (triangleAdded[i])
+				{
+					if (i == nextUnadded)
+						nextUnadded++;
+
+					continue;
+				}
+
+				if (triangleScore[i] > bestScore)
+				{
+					bestScore = triangleScore[i];
+					bestTriangle = (int)i;
+				}
+			}
+		}
+
+		// Emit the triangle.
+		const uint16_t *triangle = &indices[bestTriangle * 3];
+		memcpy(&output[t * 3], triangle, sizeof(uint16_t) * 3);
+		triangleAdded[bestTriangle] = true;
+
+		// Remove the triangle from the adjacency of its vertices.
+		for (int i = 0; i < 3; i++)
+		{
+			const uint16_t v = triangle[i];
+			int *adjacent = &adjacency[firstAdjacency[v]];
+
+			for (int j = 0; j < nActiveTriangles[v]; j++)
+			{
+				if (adjacent[j] == bestTriangle)
+				{
+					adjacent[j] = adjacent[nActiveTriangles[v] - 1];
+					break;
+				}
+			}
+
+			nActiveTriangles[v]--;
+		}
+
+		// Move the triangle vertices to the front of the cache, pushing the rest back.
+		int newCache[s_vertexCacheSize + 3];
+		int newCacheCount = 0;
+
+		for (int i = 0; i < 3; i++)
+			newCache[newCacheCount++] = triangle[i];
+
+		for (int i = 0; i < cacheCount; i++)
+		{
+			const int v = cache[i];
+
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCacheCount++] = v;
+		}
+
+		// Update the scores of everything that was in the cache, including vertices that just fell out.
+		for (int i = 0; i < newCacheCount; i++)
+		{
+			const int v = newCache[i];
+			cachePosition[v] = i < s_vertexCacheSize ? i : -1;
+			vertexScore[v] = CalculateVertexScore(cachePosition[v], nActiveTriangles[v]);
+		}
+
+		// Find the best triangle using a vertex in the cache.
+		bestTriangle = -1;
+		float bestScore = -1;
+
+		for (int i = 0; i < newCacheCount; i++)
+		{
+			const int v = newCache[i];
+
+			for (int j = 0; j < nActiveTriangles[v]; j++)
+			{
+				const int tri = adjacency[firstAdjacency[v] + j];
+				const float score = vertexScore[indices[tri * 3 + 0]] + vertexScore[indices[tri * 3 + 1]] + vertexScore[indices[tri * 3 + 2]];
+				triangleScore[tri] = score;
+
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = tri;
+				}
+			}
+		}
+
+		cacheCount = std::min(newCacheCount, s_vertexCacheSize);
+		memcpy(cache, newCache, sizeof(int) * cacheCount);
+	}
+
+	memcpy(indices, output.data(), sizeof(uint16_t) * output.size());
+}
+
+void OptimizeVertexFetch(Vertex *vertices, size_t nVertices, uint16_t *indices, size_t nIndices)
+{
+	assert(vertices);
+	assert(indices);
+	std::vector<int> remap(nVertices, -1);
+	int nRemapped = 0;
+
+	for (size_t i = 0; i < nIndices; i++)
+	{
+		if (indices[i] >= nVertices)
+			return;
+
+		if (remap[indices[i]] < 0)
+			remap[indices[i]] = nRemapped++;
+	}
+
+	for (size_t i = 0; i < nVertices; i++)
+	{
+		if (remap[i] < 0)
+			remap[i] = nRemapped++;
+	}
+
+	std::vector<Vertex> original(vertices, vertices + nVertices);
+
+	for (size_t i = 0; i < nVertices; i++)
+		vertices[remap[i]] = original[i];
+
+	for (size_t i = 0; i < nIndices; i++)
+		indices[i] = (uint16_t)remap[indices[i]];
+}
+
+size_t CalculateVertexCacheMisses(const uint16_t *indices, size_t nIndices, size_t cacheSize)
+{
+	assert(indices);
+	std::vector<uint16_t> cache;
+	cache.reserve(cacheSize);
+	size_t next = 0, nMisses = 0;
+
+	for (size_t i = 0; i < nIndices; i++)
+	{
+		if (std::find(cache.begin(), cache.end(), indices[i]) != cache.end())
+			continue;
+
+		nMisses++;
+
+		if (cache.size() < cacheSize)
+		{
+			cache.push_back(indices[i]);
+		}
+		else
+		{
+			cache[next] = indices[i];
+			next = (next + 1) % cacheSize;
+		}
+	}
+
+	return nMisses;
+}
+
 vec3 MirroredPoint(const vec3 in, const Transform &surface, const Transform &camera)
 {
 	const vec3 local = in - surface.position;
@@ -54,7 +54,14 @@ static bool SurfaceCompare(const Surface *s1, const Surface *s2)
 		else if (s1->fogIndex == s2->fogIndex)
 		{
 			if (s1->bufferIndex < s2->bufferIndex)
+			{
 				return true;
+			}
+			else if (s1->bufferIndex == s2->bufferIndex)
+			{
+				// Surfaces with patch LODs go last in their batch.
+				return !s1->hasPatchLods && s2->hasPatchLods;
+			}
 		}
 	}
 
@@ -66,6 +73,97 @@ static bool IgnoreSurface(const Surface &surface)
 	return surface.type == SurfaceType::Ignore || surface.type == SurfaceType::Flare;
 }
 
+/// Surfaces that need full vertex data after the world geometry is compacted.
+static bool SurfaceNeedsVertices(const Surface &surface)
+{
+	if (IgnoreSurface(surface))
+		return false;
+
+	const Material *m = surface.material;
+	return m->hasAutoSpriteDeform() || m->isSky || m->isPortal || m->reflective != MaterialReflective::None;
+}
+
+/// @brief Full vertex data for a surface.
+/// @remarks Index with surface indices minus Surface::firstVertex.
+static const Vertex *GetSurfaceVertices(const Surface &surface)
+{
+	if (s_world->compactGeometry)
+	{
+		assert(!surface.vertices.empty());
+		return surface.vertices.data();
+	}
+
+	return &s_world->vertices[surface.bufferIndex][surface.firstVertex];
+}
+
+static vec3 GetVertexPosition(size_t bufferIndex, uint32_t index)
+{
+	return s_world->compactGeometry ? s_world->vertexPositions[bufferIndex][index] : s_world->vertices[bufferIndex][index].pos;
+}
+
+static uint32_t GetNumVertices(size_t bufferIndex)
+{
+	return uint32_t(s_world->compactGeometry ? s_world->vertexPositions[bufferIndex].size() : s_world->vertices[bufferIndex].size());
+}
+
+static uint16_t IndexBufferFlags()
+{
+	return s_world->index32 ? BGFX_BUFFER_INDEX32 : BGFX_BUFFER_NONE;
+}
+
+/// Copy indices to bgfx memory in the index buffer format.
+static const bgfx::Memory *CopyIndices(const uint32_t *indices, size_t nIndices)
+{
+	if (s_world->index32)
+		return bgfx::copy(indices, uint32_t(nIndices * sizeof(uint32_t)));
+
+	const bgfx::Memory *mem = bgfx::alloc(uint32_t(nIndices * sizeof(uint16_t)));
+	auto dest = (uint16_t *)mem->data;
+
+	for (size_t i = 0; i < nIndices; i++)
+	{
+		dest[i] = (uint16_t)indices[i];
+	}
+
+	return mem;
+}
+
+static const bgfx::Memory *CopyIndices(const std::vector<uint32_t> &indices)
+{
+	return CopyIndices(indices.data(), indices.size());
+}
+
+const uint32_t *Surface::getIndices() const
+{
+	return s_world->surfaceIndices.data() + firstIndex;
+}
+
+/// @brief Append the indices of a list of surfaces. Surfaces that are contiguous in World::surfaceIndices are copied in a single run.
+/// @return The number of indices appended.
+static uint32_t AppendSurfaceIndices(const Surface * const *surfaces, size_t nSurfaces, std::vector<uint32_t> *indices)
+{
+	assert(indices);
+	uint32_t nAppended = 0;
+
+	for (size_t i = 0; i < nSurfaces; i++)
+	{
+		const uint32_t runFirstIndex = surfaces[i]->firstIndex;
+		uint32_t runNumIndices = surfaces[i]->nIndices;
+
+		while (i + 1 < nSurfaces && surfaces[i + 1]->firstIndex == runFirstIndex + runNumIndices)
+		{
+			runNumIndices += surfaces[++i]->nIndices;
+		}
+
+		const size_t copyIndex = indices->size();
+		indices->resize(indices->size() + runNumIndices);
+		memcpy(&(*indices)[copyIndex], &s_world->surfaceIndices[runFirstIndex], runNumIndices * sizeof(uint32_t));
+		nAppended += runNumIndices;
+	}
+
+	return nAppended;
+}
+
 class WorldModel : public Model
 {
 public:
@@ -138,7 +236,7 @@ public:
 			dc.modelMatrix = modelMatrix;
 			dc.vb.type = DrawCall::BufferType::Static;
 			dc.vb.staticHandle = s_world->vertexBuffers[surface.bufferIndex].handle;
-			dc.vb.nVertices = (uint32_t)s_world->vertices[surface.bufferIndex].size();
+			dc.vb.nVertices = GetNumVertices(surface.bufferIndex);
 			dc.ib.type = DrawCall::BufferType::Static;
 			dc.ib.staticHandle = indexBuffers_[surface.bufferIndex].handle;
 			dc.ib.firstIndex = surface.firstIndex;
@@ -182,18 +280,11 @@ public:
 
 				// Grab the indices for all surfaces in this batch.
 				bs.bufferIndex = surface->bufferIndex;
-				std::vector<uint16_t> &indices = indices_[bs.bufferIndex];
+				std::vector<uint32_t> &indices = indices_[bs.bufferIndex];
 				bs.firstIndex = (uint32_t)indices.size();
 				bs.nIndices = 0;
 
-				for (size_t j = firstSurface; j <= i; j++)
-				{
-					const Surface *s = surfaces[j];
-					const size_t copyIndex = indices.size();
-					indices.resize(indices.size() + s->indices.size());
-					memcpy(&indices[copyIndex], &s->indices[0], s->indices.size() * sizeof(uint16_t));
-					bs.nIndices += (uint32_t)s->indices.size();
-				}
+				bs.nIndices = AppendSurfaceIndices(surfaces.data() + firstSurface, i + 1 - firstSurface, &indices);
 
 				batchedSurfaces_.push_back(bs);
 				firstSurface = i + 1;
@@ -204,12 +295,12 @@ public:
 		for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
 		{
 			IndexBuffer &ib = indexBuffers_[i];
-			std::vector<uint16_t> &indices = indices_[i];
+			std::vector<uint32_t> &indices = indices_[i];
 
 			if (indices.empty())
 				continue;
 
-			ib.handle = bgfx::createIndexBuffer(bgfx::makeRef(indices.data(), uint32_t(indices.size() * sizeof(uint16_t))));
+			ib.handle = bgfx::createIndexBuffer(CopyIndices(indices), IndexBufferFlags());
 		}
 	}
 
@@ -225,7 +316,7 @@ private:
 
 	int index_;
 	std::vector<BatchedSurface> batchedSurfaces_;
-	std::vector<uint16_t> indices_[s_maxWorldGeometryBuffers];
+	std::vector<uint32_t> indices_[s_maxWorldGeometryBuffers];
 	IndexBuffer indexBuffers_[s_maxWorldGeometryBuffers];
 };
 
@@ -250,12 +341,22 @@ static Material *FindMaterial(int materialIndex, int lightmapIndex)
 	return material;
 }
 
-static void SetSurfaceGeometry(Surface *surface, const Vertex *vertices, int nVertices, const uint16_t *indices, size_t nIndices, int lightmapIndex)
+/// Post-transform vertex cache statistics for all the surfaces in a map.
+struct VertexCacheStats
+{
+	size_t nTriangles = 0;
+	size_t nMissesBefore = 0;
+	size_t nMissesAfter = 0;
+};
+
+/// @brief Reserve space for a surface's vertices in the current geometry buffer.
+/// @remarks Must be called serially, in surface order. SetSurfaceGeometry fills the reserved range and can be called from any thread.
+static void AllocateSurfaceGeometry(Surface *surface, int nVertices)
 {
 	std::vector<Vertex> *bufferVertices = &s_world->vertices[s_world->currentGeometryBuffer];
 
 	// Increment the current vertex buffer if the vertices won't fit.
-	if (bufferVertices->size() + nVertices >= UINT16_MAX)
+	if (!s_world->index32 && bufferVertices->size() + nVertices >= UINT16_MAX)
 	{
 		if (++s_world->currentGeometryBuffer == s_maxWorldGeometryBuffers)
 			interface::Error("Not enough world vertex buffers");
@@ -263,11 +364,45 @@ static void SetSurfaceGeometry(Surface *surface, const Vertex *vertices, int nVe
 		bufferVertices = &s_world->vertices[s_world->currentGeometryBuffer];
 	}
 
-	// Append the vertices into the current vertex buffer.
-	auto startVertex = (const uint32_t)bufferVertices->size();
+	// The surface needs to know which vertex buffer to use.
+	surface->bufferIndex = s_world->currentGeometryBuffer;
+
+	// CPU deforms need to know which vertices to use.
+	surface->firstVertex = (uint32_t)bufferVertices->size();
+	surface->nVertices = (uint32_t)nVertices;
 	bufferVertices->resize(bufferVertices->size() + nVertices);
+}
+
+template<typename IndexType>
+static void SetSurfaceGeometry(Surface *surface, const Vertex *vertices, const IndexType *indices, size_t nIndices, int lightmapIndex, bool optimizeVertexFetch, VertexCacheStats *vertexCacheStats)
+{
+	assert(vertexCacheStats);
+	std::vector<Vertex> *bufferVertices = &s_world->vertices[surface->bufferIndex];
+	const uint32_t startVertex = surface->firstVertex;
+	const int nVertices = (int)surface->nVertices;
 	memcpy(&(*bufferVertices)[startVertex], vertices, nVertices * sizeof(Vertex));
 
+	// Reorder triangles for the post-transform vertex cache, then vertices for fetching.
+	// Autosprite deforms expect the original quad order.
+	std::vector<uint16_t> optimizedIndices(indices, indices + nIndices);
+	const size_t nMissesBefore = util::CalculateVertexCacheMisses(optimizedIndices.data(), nIndices);
+	vertexCacheStats->nTriangles += nIndices / 3;
+	vertexCacheStats->nMissesBefore += nMissesBefore;
+
+	if (surface->material->hasAutoSpriteDeform())
+	{
+		vertexCacheStats->nMissesAfter += nMissesBefore;
+	}
+	else
+	{
+		util::OptimizeVertexCache(optimizedIndices.data(), nIndices, nVertices);
+
+		if (optimizeVertexFetch)
+			util::OptimizeVertexFetch(&(*bufferVertices)[startVertex], nVertices, optimizedIndices.data(), nIndices);
+
+		vertexCacheStats->nMissesAfter += util::CalculateVertexCacheMisses(optimizedIndices.data(), nIndices);
+	}
+
 	for (int i = 0; i < nVertices; i++)
 	{
 		Vertex *v = &(*bufferVertices)[startVertex + i];
@@ -280,20 +415,82 @@ static void SetSurfaceGeometry(Surface *surface, const Vertex *vertices, int nVe
 		}
 	}
 
-	// The surface needs to know which vertex buffer to use.
-	surface->bufferIndex = s_world->currentGeometryBuffer;
+	// Copy indices into the surface's range of the index pool. Relative indices are made absolute.
+	assert(nIndices == surface->nIndices);
+	uint32_t *surfaceIndices = &s_world->surfaceIndices[surface->firstIndex];
 
-	// CPU deforms need to know which vertices to use.
-	surface->firstVertex = startVertex;
-	surface->nVertices = (uint32_t)nVertices;
+	for (size_t i = 0; i < nIndices; i++)
+	{
+		surfaceIndices[i] = optimizedIndices[i] + startVertex;
+	}
+}
 
-	// Copy indices into the surface. Relative indices are made absolute.
-	surface->indices.resize(nIndices);
+/// LOD error thresholds for each patch LOD, from full detail to coarsest. See CalculatePatchLod.
+static const std::array<float, s_nPatchLods> s_patchLodErrors = { FLT_MAX, 2.0f, 1.0f, 0.5f, 0.25f, 0.125f };
 
-	for (size_t i = 0; i < nIndices; i++)
+/// @brief Precompute the patch LOD index sets.
+/// @remarks The LOD index sets reference the patch vertices in grid order, so vertex fetch optimization must be skipped for the surface if this returns true.
+/// @return false if the patch has a single LOD.
+/// @param lodIndexSets The LOD index sets. PatchLod ranges are relative to lodIndices until they're appended to World::surfaceIndices.
+static bool CreatePatchLods(Surface *surface, std::vector<uint32_t> *lodIndexSets)
+{
+	assert(surface->patch);
+	assert(lodIndexSets);
+	lodIndexSets->clear();
+
+	if (surface->material->hasAutoSpriteDeform())
+		return false;
+
+	std::vector<uint16_t> lodIndices, previousLodIndices;
+	surface->patchLods[0].firstIndex = surface->patchLods[0].nIndices = 0;
+
+	for (size_t i = 1; i < s_nPatchLods; i++)
 	{
-		surface->indices[i] = indices[i] + startVertex;
+		if (!Patch_CreateLodIndices(surface->patch, s_patchLodErrors[i], &lodIndices))
+		{
+			// Same as full detail.
+			surface->patchLods[i] = surface->patchLods[0];
+			continue;
+		}
+
+		if (lodIndices == previousLodIndices)
+		{
+			surface->patchLods[i] = surface->patchLods[i - 1];
+			continue;
+		}
+
+		previousLodIndices = lodIndices;
+		util::OptimizeVertexCache(lodIndices.data(), lodIndices.size(), surface->patch->numVerts);
+		PatchLod &lod = surface->patchLods[i];
+		lod.firstIndex = (uint32_t)lodIndexSets->size();
+		lod.nIndices = (uint32_t)lodIndices.size();
+
+		for (uint16_t index : lodIndices)
+		{
+			lodIndexSets->push_back(index + surface->firstVertex);
+		}
 	}
+
+	return !lodIndexSets->empty();
+}
+
+/// @brief Pick a patch LOD from the distance to the camera, in the same way as the original Q3A renderer.
+/// @remarks Patches in the same LOD group share lodOrigin and lodRadius, so they always pick the same LOD.
+static size_t CalculatePatchLod(const Surface &surface, vec3 cameraPosition)
+{
+	const float curveError = g_cvars.lodCurveError.getFloat();
+
+	if (curveError <= 0)
+		return 0;
+
+	const float distance = std::max(1.0f, (surface.patch->lodOrigin - cameraPosition).length() - surface.patch->lodRadius);
+	const float lodError = curveError / distance;
+	size_t lod = 0;
+
+	while (lod + 1 < s_nPatchLods && s_patchLodErrors[lod + 1] >= lodError)
+		lod++;
+
+	return lod;
 }
 
 static void ReleaseLightmapAtlasImage(void *data, void *userData)
@@ -301,7 +498,7 @@ static void ReleaseLightmapAtlasImage(void *data, void *userData)
 	free(data);
 }
 
-static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::vector<BatchedSurface> *batchedSurfaces, std::vector<uint16_t> *batchedIndices, std::vector<Vertex> *cpuDeformVertices, std::vector<uint16_t> *cpuDeformIndices)
+static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::vector<BatchedSurface> *batchedSurfaces, std::vector<uint32_t> *batchedIndices, std::vector<Vertex> *cpuDeformVertices, std::vector<uint16_t> *cpuDeformIndices)
 {
 	assert(batchedSurfaces);
 	assert(batchedIndices);
@@ -367,21 +564,23 @@ static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::v
 
 					// Make room in destination.
 					const size_t firstDestIndex = cpuDeformIndices->size();
-					cpuDeformIndices->resize(cpuDeformIndices->size() + s->indices.size());
+					cpuDeformIndices->resize(cpuDeformIndices->size() + s->nIndices);
 					const size_t firstDestVertex = cpuDeformVertices->size();
 					cpuDeformVertices->resize(cpuDeformVertices->size() + s->nVertices);
 
 					// Append geometry.
-					memcpy(&(*cpuDeformVertices)[firstDestVertex], &s_world->vertices[surface->bufferIndex][s->firstVertex], sizeof(Vertex) * s->nVertices);
+					memcpy(&(*cpuDeformVertices)[firstDestVertex], GetSurfaceVertices(*s), sizeof(Vertex) * s->nVertices);
+
+					const uint32_t *indices = s->getIndices();
 
-					for (size_t k = 0; k < s->indices.size(); k++)
+					for (size_t k = 0; k < s->nIndices; k++)
 					{
 						// Make indices relative.
-						(*cpuDeformIndices)[firstDestIndex + k] = uint16_t(s->indices[k] - s->firstVertex + bs.nVertices);
+						(*cpuDeformIndices)[firstDestIndex + k] = uint16_t(indices[k] - s->firstVertex + bs.nVertices);
 					}
 
 					bs.nVertices += s->nVertices;
-					bs.nIndices += (uint32_t)s->indices.size();
+					bs.nIndices += s->nIndices;
 				}
 			}
 			else
@@ -389,17 +588,24 @@ static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::v
 				// Grab the indices for all surfaces in this batch.
 				// They will be used directly by a dynamic index buffer.
 				bs.bufferIndex = surface->bufferIndex;
-				std::vector<uint16_t> &indices = batchedIndices[bs.bufferIndex];
+				std::vector<uint32_t> &indices = batchedIndices[bs.bufferIndex];
 				bs.firstIndex = (uint32_t)indices.size();
-				bs.nIndices = 0;
 
-				for (size_t j = firstSurface; j <= i; j++)
+				// Surfaces with patch LODs are sorted last.
+				size_t firstLodSurface = firstSurface;
+
+				while (firstLodSurface <= i && !surfaces[firstLodSurface]->hasPatchLods)
+					firstLodSurface++;
+
+				bs.nStaticIndices = AppendSurfaceIndices(surfaces.data() + firstSurface, firstLodSurface - firstSurface, &indices);
+				bs.nIndices = bs.nStaticIndices;
+
+				if (firstLodSurface <= i)
 				{
-					Surface *s = surfaces[j];
-					const size_t copyIndex = indices.size();
-					indices.resize(indices.size() + s->indices.size());
-					memcpy(&indices[copyIndex], &s->indices[0], s->indices.size() * sizeof(uint16_t));
-					bs.nIndices += (uint32_t)s->indices.size();
+					// Surfaces with patch LODs start at full detail, which reserves enough room for any LOD.
+					bs.firstLodSurface = (uint32_t)firstLodSurface;
+					bs.nLodSurfaces = uint32_t(i + 1 - firstLodSurface);
+					bs.nIndices += AppendSurfaceIndices(surfaces.data() + firstLodSurface, bs.nLodSurfaces, &indices);
 				}
 			}
 
@@ -430,17 +636,60 @@ static void CreateOrAppendSkySurface(std::vector<SkySurface> &skySurfaces, const
 	}
 
 	const size_t startVertex = skySurface->vertices.size();
-	skySurface->vertices.resize(skySurface->vertices.size() + surface.indices.size());
+	skySurface->vertices.resize(skySurface->vertices.size() + surface.nIndices);
+
+	const Vertex *vertices = GetSurfaceVertices(surface);
+
+	const uint32_t *indices = surface.getIndices();
+
+	for (size_t l = 0; l < surface.nIndices; l++)
+	{
+		skySurface->vertices[startVertex + l] = vertices[indices[l] - surface.firstVertex];
+	}
+}
+
+/// @brief Free the CPU copy of the world vertices now that they've been uploaded.
+/// @remarks Positions are kept for queries like MarkFragments. Surfaces that need full vertex data at runtime get their own copy.
+static void CompactGeometry()
+{
+	size_t nFullVertices = 0;
+
+	for (Surface &surface : s_world->surfaces)
+	{
+		if (!SurfaceNeedsVertices(surface))
+			continue;
+
+		const Vertex *vertices = &s_world->vertices[surface.bufferIndex][surface.firstVertex];
+		surface.vertices.assign(vertices, vertices + surface.nVertices);
+		nFullVertices += surface.nVertices;
+	}
+
+	size_t nVertices = 0;
 
-	for (size_t l = 0; l < surface.indices.size(); l++)
+	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
 	{
-		skySurface->vertices[startVertex + l] = s_world->vertices[surface.bufferIndex][surface.indices[l]];
+		const std::vector<Vertex> &vertices = s_world->vertices[i];
+		std::vector<vec3> &positions = s_world->vertexPositions[i];
+		positions.resize(vertices.size());
+
+		for (size_t j = 0; j < vertices.size(); j++)
+		{
+			positions[j] = vertices[j].pos;
+		}
+
+		nVertices += vertices.size();
+		std::vector<Vertex>().swap(s_world->vertices[i]);
 	}
+
+	s_world->compactGeometry = true;
+	const size_t nBytesFreed = nVertices * sizeof(Vertex) - (nVertices * sizeof(vec3) + nFullVertices * sizeof(Vertex));
+	interface::Printf("Compacted world geometry, freeing %d KB.\n", int(nBytesFreed / 1024));
 }
 
 void Load(const char *name)
 {
 	s_world = std::make_unique<World>();
+	s_world->index32 = (bgfx::getCaps()->supported & BGFX_CAPS_INDEX32) != 0;
 	util::Strncpyz(s_world->name, name, sizeof(s_world->name));
 	util::Strncpyz(s_world->baseName, util::SkipPath(s_world->name), sizeof(s_world->baseName));
 	util::StripExtension(s_world->baseName, s_world->baseName, sizeof(s_world->baseName));
@@ -507,9 +756,18 @@ void Load(const char *name)
 	s_world->entityParsePoint = s_world->entityString.data();
 		
 	// Parse.
+	// Keys and values are stored in a single string pool. Keys are interned.
 	char *p = s_world->entityString.data();
 	bool parsingEntity = false;
 	Entity entity;
+	s_world->entityStringPool.reserve(lump.filelen);
+
+	auto addPoolString = [](const char *string)
+	{
+		const uint32_t offset = (uint32_t)s_world->entityStringPool.size();
+		s_world->entityStringPool.insert(s_world->entityStringPool.end(), string, string + strlen(string) + 1);
+		return offset;
+	};
 
 	for (;;)
 	{
@@ -527,6 +785,7 @@ void Load(const char *name)
 			}
 
 			parsingEntity = true;
+			entity.firstKvp = (uint32_t)s_world->entityKvps.size();
 			entity.nKvps = 0;
 		}
 		else if (*token == '}') // End of entity definition.
@@ -555,23 +814,29 @@ void Load(const char *name)
 		else
 		{
 			// Parse KVP.
-			if (entity.nKvps == entity.kvps.size())
+			EntityKVP kvp;
+			const int key = FindEntityKey(token);
+
+			if (key == -1)
 			{
-				interface::PrintWarningf("Exceeded max entity KVPs\n");
-				break;
+				kvp.key = (uint32_t)s_world->entityKeys.size();
+				s_world->entityKeys.push_back(addPoolString(token));
+			}
+			else
+			{
+				kvp.key = (uint32_t)key;
 			}
 
-			EntityKVP &kvp = entity.kvps[entity.nKvps];
-			util::Strncpyz(kvp.key, token, sizeof(kvp.key));
 			token = util::Parse(&p);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("Empty KVP in entity string. Key is \"%s\"\n", kvp.key);
+				interface::PrintWarningf("Empty KVP in entity string. Key is \"%s\"\n", &s_world->entityStringPool[s_world->entityKeys[kvp.key]]);
 				break;
 			}
 
-			util::Strncpyz(kvp.value, token, sizeof(kvp.value));
+			kvp.value = addPoolString(token);
+			s_world->entityKvps.push_back(kvp);
 			entity.nKvps++;
 		}
 	}
@@ -671,9 +936,10 @@ void Load(const char *name)
 		if (nLightmaps)
 		{
 			// Figure out how atlas dimensions by packing lightmaps into cells.
-			const int maxCells = 4; // 4x128 = 512
+			// Use a single atlas if it fits in the maximum texture size, so materials don't depend on which lightmap a surface uses and can be batched together.
+			const int maxCells = std::max(1, int(bgfx::getCaps()->limits.maxTextureSize) / s_world->lightmapSize);
 
-			if (nLightmaps <= maxCells)
+			if (nLightmaps <= 4)
 			{
 				// Simple case.
 				s_world->lightmapAtlasSize.x = (int)nLightmaps;
@@ -681,16 +947,9 @@ void Load(const char *name)
 			}
 			else
 			{
-				if ((nLightmaps & (nLightmaps - 1)) == 0)
-				{
-					// Power of two. Use square size.
-					s_world->lightmapAtlasSize.x = s_world->lightmapAtlasSize.y = (int)ceil(sqrtf((float)nLightmaps));
-				}
-				else
-				{
-					s_world->lightmapAtlasSize.x = std::min(maxCells, (int)nLightmaps);
-					s_world->lightmapAtlasSize.y = (int)ceil(nLightmaps / (float)s_world->lightmapAtlasSize.x);
-				}
+				// Square-ish.
+				s_world->lightmapAtlasSize.x = (int)ceil(sqrtf((float)nLightmaps));
+				s_world->lightmapAtlasSize.y = (int)ceil(nLightmaps / (float)s_world->lightmapAtlasSize.x);
 			}
 
 			s_world->lightmapAtlasSize.x = std::min(s_world->lightmapAtlasSize.x, maxCells);
@@ -700,43 +959,42 @@ void Load(const char *name)
 
 			// Pack lightmaps into atlas(es).
 			interface::Printf("Packing %d lightmaps into %d atlas(es) sized %dx%d.\n", (int)nLightmaps, (int)s_world->lightmapAtlases.size(), s_world->lightmapAtlasSize.x * s_world->lightmapSize, s_world->lightmapAtlasSize.y * s_world->lightmapSize);
-			size_t lightmapIndex = 0;
+			std::vector<Image> atlasImages(s_world->lightmapAtlases.size());
 
-			for (size_t i = 0; i < s_world->lightmapAtlases.size(); i++)
+			for (Image &image : atlasImages)
 			{
-				Image image;
 				image.width = s_world->lightmapAtlasSize.x * s_world->lightmapSize;
 				image.height = s_world->lightmapAtlasSize.y * s_world->lightmapSize;
 				image.nComponents = 4;
 				image.dataSize = image.width * image.height * image.nComponents;
 				image.data = (uint8_t *)malloc(image.dataSize);
 				image.release = ReleaseLightmapAtlasImage;
-				int nAtlasedLightmaps = 0;
+			}
 
-				for (;;)
+			// Each lightmap writes to its own atlas cell, so they can be expanded in parallel.
+			util::ParallelFor(nLightmaps, [&](size_t lightmapIndex)
+			{
+				Image &image = atlasImages[lightmapIndex / s_world->nLightmapsPerAtlas];
+				const uint8_t *lightmapData = &srcData[lightmapIndex * srcDataSize];
+				const int cell = int(lightmapIndex % s_world->nLightmapsPerAtlas);
+				const int lightmapX = cell % s_world->lightmapAtlasSize.x;
+				const int lightmapY = cell / s_world->lightmapAtlasSize.x;
+
+				// Expand from 24bpp to 32bpp with overbright and RGBM encoding.
+				for (int y = 0; y < s_world->lightmapSize; y++)
 				{
-					// Expand from 24bpp to 32bpp with overbright and RGBM encoding.
-					for (int y = 0; y < s_world->lightmapSize; y++)
+					for (int x = 0; x < s_world->lightmapSize; x++)
 					{
-						for (int x = 0; x < s_world->lightmapSize; x++)
-						{
-							const uint8_t *src = &srcData[(x + y * s_world->lightmapSize) * 3];
-							const int lightmapX = (nAtlasedLightmaps % s_world->nLightmapsPerAtlas) % s_world->lightmapAtlasSize.x;
-							const int lightmapY = (nAtlasedLightmaps % s_world->nLightmapsPerAtlas) / s_world->lightmapAtlasSize.x;
-							auto dest = (vec4b *)&image.data[((lightmapX * s_world->lightmapSize + x) + (lightmapY * s_world->lightmapSize + y) * (s_world->lightmapAtlasSize.x * s_world->lightmapSize)) * image.nComponents];
-							*dest = vec4b(vec4(util::OverbrightenColor(vec3::fromBytes(src)), 1));
-						}
+						const uint8_t *src = &lightmapData[(x + y * s_world->lightmapSize) * 3];
+						auto dest = (vec4b *)&image.data[((lightmapX * s_world->lightmapSize + x) + (lightmapY * s_world->lightmapSize + y) * image.width) * image.nComponents];
+						*dest = vec4b(vec4(util::OverbrightenColor(vec3::fromBytes(src)), 1));
 					}
-
-					nAtlasedLightmaps++;
-					lightmapIndex++;
-					srcData += srcDataSize;
-
-					if (nAtlasedLightmaps >= s_world->nLightmapsPerAtlas || lightmapIndex >= nLightmaps)
-						break;
 				}
+			});
 
-				s_world->lightmapAtlases[i] = g_textureCache->create(util::VarArgs("*lightmap%d", (int)i), image, TextureFlags::ClampToEdge | TextureFlags::Mutable);
+			for (size_t i = 0; i < s_world->lightmapAtlases.size(); i++)
+			{
+				s_world->lightmapAtlases[i] = g_textureCache->create(util::VarArgs("*lightmap%d", (int)i), atlasImages[i], TextureFlags::ClampToEdge | TextureFlags::Mutable);
 			}
 		}
 	}
@@ -807,29 +1065,35 @@ void Load(const char *name)
 	std::vector<Vertex> vertices(header->lumps[LUMP_DRAWVERTS].filelen / sizeof(drawVert_t));
 	auto fileDrawVerts = (const drawVert_t *)(fileData + header->lumps[LUMP_DRAWVERTS].fileofs);
 
-	for (size_t i = 0; i < vertices.size(); i++)
+	// Converted in batches, since the color conversion is the most expensive part of loading a large map.
+	const size_t vertexBatchSize = 4096;
+
+	util::ParallelFor((vertices.size() + vertexBatchSize - 1) / vertexBatchSize, [&](size_t batch)
 	{
-		Vertex &v = vertices[i];
-		const drawVert_t &fv = fileDrawVerts[i];
-		v.pos = vec3(LittleFloat(fv.xyz[0]), LittleFloat(fv.xyz[1]), LittleFloat(fv.xyz[2]));
-		v.normal = vec3(LittleFloat(fv.normal[0]), LittleFloat(fv.normal[1]), LittleFloat(fv.normal[2]));
-		v.texCoord = vec4(LittleFloat(fv.st[0]), LittleFloat(fv.st[1]), LittleFloat(fv.lightmap[0]), LittleFloat(fv.lightmap[1]));
-		v.setColor(util::ToLinear(vec4(util::OverbrightenColor(vec3::fromBytes(fv.color)), fv.color[3] / 255.0f)));
-	}
+		const size_t end = std::min(vertices.size(), (batch + 1) * vertexBatchSize);
+
+		for (size_t i = batch * vertexBatchSize; i < end; i++)
+		{
+			Vertex &v = vertices[i];
+			const drawVert_t &fv = fileDrawVerts[i];
+			v.pos = vec3(LittleFloat(fv.xyz[0]), LittleFloat(fv.xyz[1]), LittleFloat(fv.xyz[2]));
+			v.normal = vec3(LittleFloat(fv.normal[0]), LittleFloat(fv.normal[1]), LittleFloat(fv.normal[2]));
+			v.texCoord = vec4(LittleFloat(fv.st[0]), LittleFloat(fv.st[1]), LittleFloat(fv.lightmap[0]), LittleFloat(fv.lightmap[1]));
+			v.setColor(util::ToLinear(vec4(util::OverbrightenColor(vec3::fromBytes(fv.color)), fv.color[3] / 255.0f)));
+		}
+	});
 
 	// Indices
-	std::vector<uint16_t> indices(header->lumps[LUMP_DRAWINDEXES].filelen / sizeof(int));
+	// The lump is read in place. LittleLong is a no-op on the little-endian hosts the renderer supports, and SetSurfaceGeometry narrows to 16-bit relative indices itself.
 	auto fileDrawIndices = (const int *)(fileData + header->lumps[LUMP_DRAWINDEXES].fileofs);
 
-	for (size_t i = 0; i < indices.size(); i++)
-	{
-		indices[i] = LittleLong(fileDrawIndices[i]);
-	}
-
 	// Surfaces
 	s_world->surfaces.resize(header->lumps[LUMP_SURFACES].filelen / sizeof(dsurface_t));
 	auto fileSurfaces = (const dsurface_t *)(fileData + header->lumps[LUMP_SURFACES].fileofs);
+	std::vector<int> surfaceLightmapIndices(s_world->surfaces.size());
+	std::vector<Surface *> patchSurfaces;
 
+	// Material lookup isn't thread safe, so surfaces are set up serially. The expensive per-surface work is done in parallel afterwards.
 	for (size_t i = 0; i < s_world->surfaces.size(); i++)
 	{
 		Surface &s = s_world->surfaces[i];
@@ -844,6 +1108,7 @@ void Load(const char *name)
 			lightmapIndex = MaterialLightmapId::Vertex;
 		}
 
+		surfaceLightmapIndices[i] = lightmapIndex;
 		const int shaderNum = LittleLong(fs.shaderNum);
 		s.material = FindMaterial(shaderNum, lightmapIndex);
 		s.flags = s_world->materials[shaderNum].surfaceFlags;
@@ -857,55 +1122,177 @@ void Load(const char *name)
 		else if (type == MST_PLANAR)
 		{
 			s.type = SurfaceType::Face;
-			const int firstVertex = LittleLong(fs.firstVert);
-			const int nVertices = LittleLong(fs.numVerts);
-			SetSurfaceGeometry(&s, &vertices[firstVertex], nVertices, &indices[LittleLong(fs.firstIndex)], LittleLong(fs.numIndexes), lightmapIndex);
-
-			// Setup cullinfo.
 			s.cullinfo.type = CullInfoType::Box | CullInfoType::Plane;
-			s.cullinfo.bounds.setupForAddingPoints();
+		}
+		else if (type == MST_TRIANGLE_SOUP)
+		{
+			s.type = SurfaceType::Mesh;
+		}
+		else if (type == MST_PATCH)
+		{
+			s.type = SurfaceType::Patch;
+			patchSurfaces.push_back(&s);
+		}
+		else if (type == MST_FLARE)
+		{
+			s.type = SurfaceType::Flare;
+		}
+	}
 
-			for (int i = 0; i < nVertices; i++)
-			{
-				s.cullinfo.bounds.addPoint(vertices[firstVertex + i].pos);
-			}
+	// Subdivide patches.
+	util::ParallelFor(patchSurfaces.size(), [&](size_t i)
+	{
+		Surface *s = patchSurfaces[i];
+		const dsurface_t &fs = fileSurfaces[s - s_world->surfaces.data()];
+		s->patch = Patch_Subdivide(LittleLong(fs.patchWidth), LittleLong(fs.patchHeight), &vertices[LittleLong(fs.firstVert)]);
 
-			// take the plane information from the lightmap vector
-			for (int i = 0; i < 3; i++)
-			{
-				s.cullinfo.plane.normal[i] = LittleFloat(fs.lightmapVecs[2][i]);
-			}
+		// Copy the LOD origin, which is the center of the group of all curves that must subdivide the same to avoid cracking.
+		Bounds lodBounds;
 
-			s.cullinfo.plane.distance = vec3::dotProduct(vertices[firstVertex].pos, s.cullinfo.plane.normal);
-			s.cullinfo.plane.setupFastBoundsTest();
+		for (int j = 0; j < 3; j++)
+		{
+			lodBounds[0][j] = LittleFloat(fs.lightmapVecs[0][j]);
+			lodBounds[1][j] = LittleFloat(fs.lightmapVecs[1][j]);
 		}
-		else if (type == MST_TRIANGLE_SOUP)
+
+		s->patch->lodOrigin = lodBounds.midpoint();
+		s->patch->lodRadius = (lodBounds.min - s->patch->lodOrigin).length();
+	});
+
+	{
+		std::vector<Patch *> patches(patchSurfaces.size());
+
+		for (size_t i = 0; i < patchSurfaces.size(); i++)
+		{
+			patches[i] = patchSurfaces[i]->patch;
+		}
+
+		Patch_FixSharedVertexLodError(patches);
+	}
+
+	// Reserve vertex buffer ranges in surface order, so the buffer layout doesn't depend on thread timing.
+	for (size_t i = 0; i < s_world->surfaces.size(); i++)
+	{
+		Surface &s = s_world->surfaces[i];
+
+		if (s.type == SurfaceType::Face || s.type == SurfaceType::Mesh)
+		{
+			AllocateSurfaceGeometry(&s, LittleLong(fileSurfaces[i].numVerts));
+		}
+		else if (s.type == SurfaceType::Patch)
+		{
+			AllocateSurfaceGeometry(&s, s.patch->numVerts);
+		}
+	}
+
+	// Reserve index pool ranges in batch order, so surfaces that are batched together can be copied in a single run.
+	{
+		std::vector<Surface *> geometrySurfaces;
+
+		for (Surface &s : s_world->surfaces)
+		{
+			if (s.type == SurfaceType::Face || s.type == SurfaceType::Mesh || s.type == SurfaceType::Patch)
+				geometrySurfaces.push_back(&s);
+		}
+
+		std::sort(geometrySurfaces.begin(), geometrySurfaces.end(), SurfaceCompare);
+		size_t nIndices = 0;
+
+		for (Surface *s : geometrySurfaces)
+		{
+			s->firstIndex = (uint32_t)nIndices;
+			s->nIndices = uint32_t(s->type == SurfaceType::Patch ? s->patch->numIndexes : LittleLong(fileSurfaces[s - s_world->surfaces.data()].numIndexes));
+			nIndices += s->nIndices;
+		}
+
+		s_world->surfaceIndices.resize(nIndices);
+	}
+
+	// Fill the reserved ranges and setup cullinfo. Each surface only writes to its own vertices and indices.
+	std::vector<VertexCacheStats> surfaceVertexCacheStats(s_world->surfaces.size());
+	std::vector<std::vector<uint32_t>> patchLodIndexSets(s_world->surfaces.size());
+
+	util::ParallelFor(s_world->surfaces.size(), [&](size_t i)
+	{
+		Surface &s = s_world->surfaces[i];
+		const dsurface_t &fs = fileSurfaces[i];
+
+		if (s.type == SurfaceType::Face || s.type == SurfaceType::Mesh)
 		{
-			s.type = SurfaceType::Mesh;
 			const int firstVertex = LittleLong(fs.firstVert);
 			const int nVertices = LittleLong(fs.numVerts);
-			SetSurfaceGeometry(&s, &vertices[firstVertex], nVertices, &indices[LittleLong(fs.firstIndex)], LittleLong(fs.numIndexes), lightmapIndex);
+			SetSurfaceGeometry(&s, &vertices[firstVertex], &fileDrawIndices[LittleLong(fs.firstIndex)], LittleLong(fs.numIndexes), surfaceLightmapIndices[i], true, &surfaceVertexCacheStats[i]);
 
 			// Setup cullinfo.
 			s.cullinfo.bounds.setupForAddingPoints();
 
-			for (int i = 0; i < nVertices; i++)
+			for (int j = 0; j < nVertices; j++)
+			{
+				s.cullinfo.bounds.addPoint(vertices[firstVertex + j].pos);
+			}
+
+			if (s.type == SurfaceType::Face)
 			{
-				s.cullinfo.bounds.addPoint(vertices[firstVertex + i].pos);
+				// take the plane information from the lightmap vector
+				for (int j = 0; j < 3; j++)
+				{
+					s.cullinfo.plane.normal[j] = LittleFloat(fs.lightmapVecs[2][j]);
+				}
+
+				s.cullinfo.plane.distance = vec3::dotProduct(vertices[firstVertex].pos, s.cullinfo.plane.normal);
+				s.cullinfo.plane.setupFastBoundsTest();
 			}
 		}
-		else if (type == MST_PATCH)
+		else if (s.type == SurfaceType::Patch)
 		{
-			s.type = SurfaceType::Patch;
-			s.patch = Patch_Subdivide(LittleLong(fs.patchWidth), LittleLong(fs.patchHeight), &vertices[LittleLong(fs.firstVert)]);
-			SetSurfaceGeometry(&s, s.patch->verts, s.patch->numVerts, s.patch->indexes, s.patch->numIndexes, lightmapIndex);
+			const bool hasLods = CreatePatchLods(&s, &patchLodIndexSets[i]);
+			SetSurfaceGeometry(&s, s.patch->verts, s.patch->indexes, s.patch->numIndexes, surfaceLightmapIndices[i], !hasLods, &surfaceVertexCacheStats[i]);
 		}
-		else if (type == MST_FLARE)
+	});
+
+	// Append the patch LOD index sets to the index pool.
+	size_t nPatchLodIndices = 0;
+
+	for (const std::vector<uint32_t> &lodIndexSets : patchLodIndexSets)
+	{
+		nPatchLodIndices += lodIndexSets.size();
+	}
+
+	s_world->surfaceIndices.reserve(s_world->surfaceIndices.size() + nPatchLodIndices);
+
+	for (size_t i = 0; i < s_world->surfaces.size(); i++)
+	{
+		const std::vector<uint32_t> &lodIndexSets = patchLodIndexSets[i];
+
+		if (lodIndexSets.empty())
+			continue;
+
+		Surface &s = s_world->surfaces[i];
+		const auto offset = (uint32_t)s_world->surfaceIndices.size();
+		s_world->surfaceIndices.insert(s_world->surfaceIndices.end(), lodIndexSets.begin(), lodIndexSets.end());
+		s.hasPatchLods = true;
+
+		for (PatchLod &lod : s.patchLods)
 		{
-			s.type = SurfaceType::Flare;
+			if (lod.nIndices != 0)
+				lod.firstIndex += offset;
 		}
 	}
 
+	VertexCacheStats vertexCacheStats;
+
+	for (const VertexCacheStats &stats : surfaceVertexCacheStats)
+	{
+		vertexCacheStats.nTriangles += stats.nTriangles;
+		vertexCacheStats.nMissesBefore += stats.nMissesBefore;
+		vertexCacheStats.nMissesAfter += stats.nMissesAfter;
+	}
+
+	if (vertexCacheStats.nTriangles > 0)
+	{
+		interface::Printf("Vertex cache ACMR: %.3f before optimization, %.3f after.\n", vertexCacheStats.nMissesBefore / (float)vertexCacheStats.nTriangles, vertexCacheStats.nMissesAfter / (float)vertexCacheStats.nTriangles);
+	}
+
 	// Create brush models.
 	for (size_t i = 1; i < s_world->modelDefs.size(); i++)
 	{
@@ -928,33 +1315,30 @@ void Load(const char *name)
 	auto fileLeaves = (const dleaf_t *)(fileData + header->lumps[LUMP_LEAFS].fileofs);
 	const size_t nNodes = header->lumps[LUMP_NODES].filelen / sizeof(dnode_t);
 	const size_t nLeaves = header->lumps[LUMP_LEAFS].filelen / sizeof(dleaf_t);
-	s_world->nodes.resize(nNodes + nLeaves);
+	s_world->nodes.resize(nNodes);
+	s_world->leaves.resize(nLeaves);
 
 	for (size_t i = 0; i < nNodes; i++)
 	{
 		Node &n = s_world->nodes[i];
 		const dnode_t &fn = fileNodes[i];
+		n.plane = LittleLong(fn.planeNum);
+		n.children[0] = LittleLong(fn.children[0]);
+		n.children[1] = LittleLong(fn.children[1]);
+		const vec3 normal = s_world->planes[n.plane].normal;
+		n.axis = 3;
 
-		n.leaf = false;
-		n.bounds[0] = vec3((float)LittleLong(fn.mins[0]), (float)LittleLong(fn.mins[1]), (float)LittleLong(fn.mins[2]));
-		n.bounds[1] = vec3((float)LittleLong(fn.maxs[0]), (float)LittleLong(fn.maxs[1]), (float)LittleLong(fn.maxs[2]));
-		n.plane = &s_world->planes[LittleLong(fn.planeNum)];
-
-		for (size_t j = 0; j < 2; j++)
+		for (uint8_t j = 0; j < 3; j++)
 		{
-			const int c = LittleLong(fn.children[j]);
-			n.children[j] = &s_world->nodes[c >= 0 ? c : nNodes + (-1 - c)];
+			if (normal[j] == 1.0f)
+				n.axis = j;
 		}
 	}
 
-	s_world->firstLeaf = nNodes;
-
 	for (size_t i = 0; i < nLeaves; i++)
 	{
-		Node &l = s_world->nodes[s_world->firstLeaf + i];
+		Leaf &l = s_world->leaves[i];
 		const dleaf_t &fl = fileLeaves[i];
-
-		l.leaf = true;
 		l.bounds[0] = vec3((float)LittleLong(fl.mins[0]), (float)LittleLong(fl.mins[1]), (float)LittleLong(fl.mins[2]));
 		l.bounds[1] = vec3((float)LittleLong(fl.maxs[0]), (float)LittleLong(fl.maxs[1]), (float)LittleLong(fl.maxs[2]));
 		l.cluster = LittleLong(fl.cluster);
@@ -994,7 +1378,7 @@ void Load(const char *name)
 	// Index buffer is initialized on first use, not here.
 	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
 	{
-		s_world->vertexBuffers[i].handle = bgfx::createVertexBuffer(bgfx::makeRef(&s_world->vertices[i][0], uint32_t(s_world->vertices[i].size() * sizeof(Vertex))), Vertex::decl);
+		s_world->vertexBuffers[i].handle = bgfx::createVertexBuffer(CompactVertex::copy(s_world->vertices[i].data(), (uint32_t)s_world->vertices[i].size()), CompactVertex::decl);
 	}
 
 	// Create batched surfaces for frustum culling.
@@ -1017,7 +1401,7 @@ void Load(const char *name)
 	}
 
 	std::sort(sortedSurfaces.begin(), sortedSurfaces.end(), SurfaceCompare);
-	std::vector<uint16_t> batchedIndices[s_maxWorldGeometryBuffers];
+	std::vector<uint32_t> batchedIndices[s_maxWorldGeometryBuffers];
 	CreateBatchedSurfaces(sortedSurfaces, &s_world->batchedSurfaces, batchedIndices, &s_world->cpuDeformVertices, &s_world->cpuDeformIndices);
 
 	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
@@ -1025,8 +1409,12 @@ void Load(const char *name)
 		if (batchedIndices[i].empty())
 			continue;
 
-		const bgfx::Memory *mem = bgfx::copy(batchedIndices[i].data(), uint32_t(batchedIndices[i].size() * sizeof(uint16_t)));
-		s_world->indexBuffers[i].handle = bgfx::createIndexBuffer(mem);
+		s_world->indexBuffers[i].handle = bgfx::createIndexBuffer(CopyIndices(batchedIndices[i]), IndexBufferFlags());
+	}
+
+	if (g_cvars.compactWorldGeometry.getBool())
+	{
+		CompactGeometry();
 	}
 }
 
@@ -1191,6 +1579,11 @@ const std::vector<Vertex> &GetVertexBuffer(int index)
 	return s_world->vertices[index];
 }
 
+bool IsGeometryCompact()
+{
+	return s_world->compactGeometry;
+}
+
 bool GetEntityToken(char *buffer, int size)
 {
 	const char *s = util::Parse(&s_world->entityParsePoint, true);
@@ -1307,20 +1700,78 @@ void SampleLightGrid(vec3 position, vec3 *ambientLight, vec3 *directedLight, vec
 	lightDir->normalizeFast();
 }
 
-Node *LeafFromPosition(vec3 pos)
+const char *Entity::findValue(int key, const char *defaultValue) const
 {
-	Node *node = &s_world->nodes[0];
+	if (key == -1)
+		return defaultValue;
 
-	for (;;)
+	for (uint32_t i = 0; i < nKvps; i++)
 	{
-		if (node->leaf)
-			break;
+		const EntityKVP &kvp = s_world->entityKvps[firstKvp + i];
+
+		if (kvp.key == (uint32_t)key)
+			return &s_world->entityStringPool[kvp.value];
+	}
+
+	return defaultValue;
+}
+
+const char *Entity::findValue(const char *key, const char *defaultValue) const
+{
+	return findValue(FindEntityKey(key), defaultValue);
+}
 
-		const float d = vec3::dotProduct(pos, node->plane->normal) - node->plane->distance;
-		node = d > 0 ? node->children[0] : node->children[1];
+int FindEntityKey(const char *key)
+{
+	for (size_t i = 0; i < s_world->entityKeys.size(); i++)
+	{
+		if (!util::Stricmp(&s_world->entityStringPool[s_world->entityKeys[i]], key))
+			return (int)i;
 	}
 
-	return node;
+	return -1;
+}
+
+const Leaf *LeafFromPosition(vec3 pos)
+{
+	// A map with no nodes is a single leaf.
+	int i = s_world->nodes.empty() ? -1 : 0;
+
+	while (i >= 0)
+	{
+		const Node &node = s_world->nodes[i];
+		const Plane &plane = s_world->planes[node.plane];
+		const float d = (node.axis < 3 ? pos[node.axis] : vec3::dotProduct(pos, plane.normal)) - plane.distance;
+		i = d > 0 ? node.children[0] : node.children[1];
+	}
+
+	return &s_world->leaves[-1 - i];
+}
+
+void BenchmarkPointQueries()
+{
+	const size_t nQueries = 1000000;
+	const Bounds &bounds = s_world->modelDefs[0].bounds;
+	std::vector<vec3> points(nQueries);
+	std::minstd_rand generator(1);
+
+	for (vec3 &p : points)
+	{
+		for (size_t i = 0; i < 3; i++)
+			p[i] = math::RandomFloat(generator, bounds.min[i], bounds.max[i]);
+	}
+
+	int clusterSum = 0; // Stop the queries being optimized away.
+	const int64_t start = bx::getHPCounter();
+
+	for (const vec3 &p : points)
+	{
+		clusterSum += LeafFromPosition(p)->cluster;
+	}
+
+	const double elapsed = (bx::getHPCounter() - start) / (double)bx::getHPFrequency();
+	interface::Printf("%u point queries in %0.2fms, %0.1fns per query (%d)\n", (uint32_t)nQueries, elapsed * 1000.0, elapsed * 1e9 / nQueries, clusterSum);
+	interface::Printf("%u nodes (%u KB), %u leaves (%u KB)\n", (uint32_t)s_world->nodes.size(), (uint32_t)(s_world->nodes.size() * sizeof(Node) / 1024), (uint32_t)s_world->leaves.size(), (uint32_t)(s_world->leaves.size() * sizeof(Leaf) / 1024));
 }
 
 bool InPvs(vec3 position)
@@ -1330,7 +1781,7 @@ bool InPvs(vec3 position)
 
 bool InPvs(vec3 position1, vec3 position2)
 {
-	Node *leaf = LeafFromPosition(position1);
+	const Leaf *leaf = LeafFromPosition(position1);
 	const uint8_t *vis = interface::CM_ClusterPVS(leaf->cluster);
 	leaf = LeafFromPosition(position2);
 	return ((vis[leaf->cluster >> 3] & (1 << (leaf->cluster & 7))) != 0);
@@ -1410,32 +1861,35 @@ void CalculateFog(int fogIndex, const mat4 &modelMatrix, const mat4 &modelViewMa
 	}
 }
 
-static void BoxSurfaces_recursive(Node *node, Bounds bounds, Surface **list, int listsize, int *listlength, vec3 dir)
+static void BoxSurfaces_recursive(int nodeIndex, Bounds bounds, Surface **list, int listsize, int *listlength, vec3 dir)
 {
 	// do the tail recursion in a loop
-	while (!node->leaf)
+	while (nodeIndex >= 0)
 	{
-		int s = node->plane->testBounds(bounds);
+		const Node &node = s_world->nodes[nodeIndex];
+		int s = s_world->planes[node.plane].testBounds(bounds);
 
 		if (s == 1)
 		{
-			node = node->children[0];
+			nodeIndex = node.children[0];
 		}
 		else if (s == 2)
 		{
-			node = node->children[1];
+			nodeIndex = node.children[1];
 		}
 		else
 		{
-			BoxSurfaces_recursive(node->children[0], bounds, list, listsize, listlength, dir);
-			node = node->children[1];
+			BoxSurfaces_recursive(node.children[0], bounds, list, listsize, listlength, dir);
+			nodeIndex = node.children[1];
 		}
 	}
 
+	const Leaf &leaf = s_world->leaves[-1 - nodeIndex];
+
 	// add the individual surfaces
-	for (int i = 0; i < node->nSurfaces; i++)
+	for (int i = 0; i < leaf.nSurfaces; i++)
 	{
-		Surface *surface = &s_world->surfaces[s_world->leafSurfaces[node->firstSurface + i]];
+		Surface *surface = &s_world->surfaces[s_world->leafSurfaces[leaf.firstSurface + i]];
 
 		if (*listlength >= listsize)
 			break;
@@ -1562,7 +2016,7 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 
 	numsurfaces = 0;
 	Surface *surfaces[64];
-	BoxSurfaces_recursive(&s_world->nodes[0], bounds, surfaces, 64, &numsurfaces, projectionDir);
+	BoxSurfaces_recursive(s_world->nodes.empty() ? -1 : 0, bounds, surfaces, 64, &numsurfaces, projectionDir);
 	returnedPoints = 0;
 	returnedFragments = 0;
 
@@ -1631,13 +2085,13 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 			if (vec3::dotProduct(surface->cullinfo.plane.normal, projectionDir) > -0.5)
 				continue;
 
-			uint16_t *tri;
+			const uint32_t *tri;
 
-			for (k = 0, tri = &surface->indices[0]; k < (int)surface->indices.size(); k += 3, tri += 3)
+			for (k = 0, tri = surface->getIndices(); k < (int)surface->nIndices; k += 3, tri += 3)
 			{
 				for (j = 0; j < 3; j++)
 				{
-					clipPoints[0][j] = s_world->vertices[surface->bufferIndex][tri[j]].pos + surface->cullinfo.plane.normal * MARKER_OFFSET;
+					clipPoints[0][j] = GetVertexPosition(surface->bufferIndex, tri[j]) + surface->cullinfo.plane.normal * MARKER_OFFSET;
 				}
 
 				// add the fragments of this face
@@ -1649,13 +2103,14 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 		}
 		else if (surface->type == SurfaceType::Mesh)
 		{
-			uint16_t *tri;
+			const uint32_t *tri;
 
-			for (k = 0, tri = &surface->indices[0]; k < (int)surface->indices.size(); k += 3, tri += 3)
+			for (k = 0, tri = surface->getIndices(); k < (int)surface->nIndices; k += 3, tri += 3)
 			{
 				for (j = 0; j < 3; j++)
 				{
-					clipPoints[0][j] = s_world->vertices[surface->bufferIndex][tri[j]].pos + s_world->vertices[surface->bufferIndex][tri[j]].normal * MARKER_OFFSET;
+					// Vertex normals aren't kept when the world geometry is compacted, and the offset is 0 anyway.
+					clipPoints[0][j] = GetVertexPosition(surface->bufferIndex, tri[j]);
 				}
 
 				// add the fragments of this face
@@ -1722,24 +2177,26 @@ bool CalculatePortalCamera(VisibilityId visId, vec3 mainCameraPosition, mat3 mai
 	for (Surface *portalSurface : vis.portalSurfaces)
 	{
 		// Trivially reject.
-		if (util::IsGeometryOffscreen(mvp, portalSurface->indices.data(), portalSurface->indices.size(), s_world->vertices[portalSurface->bufferIndex].data()))
+		const Vertex *vertices = GetSurfaceVertices(*portalSurface);
+
+		if (util::IsGeometryOffscreen(mvp, portalSurface->getIndices(), portalSurface->nIndices, vertices, portalSurface->firstVertex))
 			continue;
 
 		// Determine if this surface is backfaced and also determine the distance to the nearest vertex so we can cull based on portal range.
 		// Culling based on vertex distance isn't 100% correct (we should be checking for range to the surface), but it's good enough for the types of portals we have in the game right now.
 		float shortest;
 
-		if (util::IsGeometryBackfacing(mainCameraPosition, portalSurface->indices.data(), portalSurface->indices.size(), s_world->vertices[portalSurface->bufferIndex].data(), &shortest))
+		if (util::IsGeometryBackfacing(mainCameraPosition, portalSurface->getIndices(), portalSurface->nIndices, vertices, portalSurface->firstVertex, &shortest))
 			continue;
 
 		// Calculate surface plane.
 		Plane plane;
 
-		if (portalSurface->indices.size() >= 3)
+		if (portalSurface->nIndices >= 3)
 		{
-			const vec3 v1(s_world->vertices[portalSurface->bufferIndex][portalSurface->indices[0]].pos);
-			const vec3 v2(s_world->vertices[portalSurface->bufferIndex][portalSurface->indices[1]].pos);
-			const vec3 v3(s_world->vertices[portalSurface->bufferIndex][portalSurface->indices[2]].pos);
+			const vec3 v1(GetVertexPosition(portalSurface->bufferIndex, portalSurface->getIndices()[0]));
+			const vec3 v2(GetVertexPosition(portalSurface->bufferIndex, portalSurface->getIndices()[1]));
+			const vec3 v3(GetVertexPosition(portalSurface->bufferIndex, portalSurface->getIndices()[2]));
 			plane.normal = vec3::crossProduct(v3 - v1, v2 - v1).normal();
 			plane.distance = vec3::dotProduct(v1, plane.normal);
 		}
@@ -1874,22 +2331,24 @@ bool CalculateReflectionCamera(VisibilityId visId, vec3 mainCameraPosition, mat3
 	for (Surface *surface : vis.reflectiveSurfaces)
 	{
 		// Trivially reject.
-		if (util::IsGeometryOffscreen(mvp, surface->indices.data(), surface->indices.size(), s_world->vertices[surface->bufferIndex].data()))
+		const Vertex *vertices = GetSurfaceVertices(*surface);
+
+		if (util::IsGeometryOffscreen(mvp, surface->getIndices(), surface->nIndices, vertices, surface->firstVertex))
 			continue;
 
 		// Determine if this surface is backfaced.
-		if (util::IsGeometryBackfacing(mainCameraPosition, surface->indices.data(), surface->indices.size(), s_world->vertices[surface->bufferIndex].data()))
+		if (util::IsGeometryBackfacing(mainCameraPosition, surface->getIndices(), surface->nIndices, vertices, surface->firstVertex))
 			continue;
 
 		// Reflective surface is visible to the camera.
 		Visibility::Reflective reflective;
 		reflective.surface = surface;
 
-		if (surface->indices.size() >= 3)
+		if (surface->nIndices >= 3)
 		{
-			const vec3 v1(s_world->vertices[surface->bufferIndex][surface->indices[0]].pos);
-			const vec3 v2(s_world->vertices[surface->bufferIndex][surface->indices[1]].pos);
-			const vec3 v3(s_world->vertices[surface->bufferIndex][surface->indices[2]].pos);
+			const vec3 v1(GetVertexPosition(surface->bufferIndex, surface->getIndices()[0]));
+			const vec3 v2(GetVertexPosition(surface->bufferIndex, surface->getIndices()[1]));
+			const vec3 v3(GetVertexPosition(surface->bufferIndex, surface->getIndices()[2]));
 			reflective.plane.normal = vec3::crossProduct(v3 - v1, v2 - v1).normal();
 			reflective.plane.distance = vec3::dotProduct(v1, reflective.plane.normal);
 		}
@@ -1930,8 +2389,9 @@ void RenderPortal(VisibilityId visId, DrawCallList *drawCallList)
 
 	for (const Visibility::Portal &portal : vis.cameraPortalSurfaces)
 	{
+		const Surface *surface = portal.surface;
 		bgfx::TransientIndexBuffer tib;
-		auto nIndices = (const uint32_t)portal.surface->indices.size();
+		auto nIndices = (const uint32_t)surface->nIndices;
 
 		if (bgfx::getAvailTransientIndexBuffer(nIndices) < nIndices)
 		{
@@ -1939,14 +2399,23 @@ void RenderPortal(VisibilityId visId, DrawCallList *drawCallList)
 			return;
 		}
 
+		// Make the indices relative to the first vertex of the surface so they fit in a 16-bit transient buffer.
 		bgfx::allocTransientIndexBuffer(&tib, nIndices);
-		memcpy(tib.data, portal.surface->indices.data(), nIndices * sizeof(uint16_t));
+		auto tibIndices = (uint16_t *)tib.data;
+
+		const uint32_t *indices = surface->getIndices();
+
+		for (uint32_t i = 0; i < nIndices; i++)
+		{
+			tibIndices[i] = uint16_t(indices[i] - surface->firstVertex);
+		}
 
 		DrawCall dc;
-		dc.material = portal.surface->material;
+		dc.material = surface->material;
 		dc.vb.type = DrawCall::BufferType::Static;
-		dc.vb.staticHandle = s_world->vertexBuffers[portal.surface->bufferIndex].handle;
-		dc.vb.nVertices = (uint32_t)s_world->vertices[portal.surface->bufferIndex].size();
+		dc.vb.staticHandle = s_world->vertexBuffers[surface->bufferIndex].handle;
+		dc.vb.firstVertex = surface->firstVertex;
+		dc.vb.nVertices = surface->nVertices;
 		dc.ib.type = DrawCall::BufferType::Transient;
 		dc.ib.transientHandle = tib;
 		dc.ib.nIndices = nIndices;
@@ -1961,8 +2430,9 @@ void RenderReflective(VisibilityId visId, DrawCallList *drawCallList)
 
 	for (const Visibility::Reflective &reflective : vis.cameraReflectiveSurfaces)
 	{
+		const Surface *surface = reflective.surface;
 		bgfx::TransientIndexBuffer tib;
-		auto nIndices = (const uint32_t)reflective.surface->indices.size();
+		auto nIndices = (const uint32_t)surface->nIndices;
 
 		if (bgfx::getAvailTransientIndexBuffer(nIndices) < nIndices)
 		{
@@ -1970,15 +2440,24 @@ void RenderReflective(VisibilityId visId, DrawCallList *drawCallList)
 			return;
 		}
 
+		// Make the indices relative to the first vertex of the surface so they fit in a 16-bit transient buffer.
 		bgfx::allocTransientIndexBuffer(&tib, nIndices);
-		memcpy(tib.data, reflective.surface->indices.data(), nIndices * sizeof(uint16_t));
+		auto tibIndices = (uint16_t *)tib.data;
+
+		const uint32_t *indices = surface->getIndices();
+
+		for (uint32_t i = 0; i < nIndices; i++)
+		{
+			tibIndices[i] = uint16_t(indices[i] - surface->firstVertex);
+		}
 
 		DrawCall dc;
-		dc.material = reflective.surface->material->reflectiveFrontSideMaterial;
+		dc.material = surface->material->reflectiveFrontSideMaterial;
 		assert(dc.material);
 		dc.vb.type = DrawCall::BufferType::Static;
-		dc.vb.staticHandle = s_world->vertexBuffers[reflective.surface->bufferIndex].handle;
-		dc.vb.nVertices = (uint32_t)s_world->vertices[reflective.surface->bufferIndex].size();
+		dc.vb.staticHandle = s_world->vertexBuffers[surface->bufferIndex].handle;
+		dc.vb.firstVertex = surface->firstVertex;
+		dc.vb.nVertices = surface->nVertices;
 		dc.ib.type = DrawCall::BufferType::Transient;
 		dc.ib.transientHandle = tib;
 		dc.ib.nIndices = nIndices;
@@ -1986,6 +2465,62 @@ void RenderReflective(VisibilityId visId, DrawCallList *drawCallList)
 	}
 }
 
+/// @brief Pick LODs for visible patches. Batches with patches that changed LOD have their patch indices replaced in the dynamic index buffer.
+static void UpdatePatchLods(Visibility &vis, vec3 cameraPosition)
+{
+	for (BatchedSurface &bs : vis.batchedSurfaces)
+	{
+		if (bs.nLodSurfaces == 0)
+			continue;
+
+		bool changed = false;
+
+		for (size_t i = bs.firstLodSurface; i < bs.firstLodSurface + bs.nLodSurfaces; i++)
+		{
+			const auto lod = (uint8_t)CalculatePatchLod(*vis.surfaces[i], cameraPosition);
+
+			if (lod != vis.surfacePatchLods[i])
+			{
+				vis.surfacePatchLods[i] = lod;
+				changed = true;
+			}
+		}
+
+		if (!changed)
+			continue;
+
+		// Rewrite the patch part of the batch. There's always enough room, since it was created at full detail.
+		std::vector<uint32_t> &indices = vis.indices[bs.bufferIndex];
+		const uint32_t firstLodIndex = bs.firstIndex + bs.nStaticIndices;
+		uint32_t nLodIndices = 0;
+
+		for (size_t i = bs.firstLodSurface; i < bs.firstLodSurface + bs.nLodSurfaces; i++)
+		{
+			const Surface &surface = *vis.surfaces[i];
+			const uint8_t lod = vis.surfacePatchLods[i];
+			const uint32_t *src;
+			uint32_t nIndices;
+
+			if (lod == 0 || surface.patchLods[lod].nIndices == 0)
+			{
+				src = surface.getIndices();
+				nIndices = (uint32_t)surface.nIndices;
+			}
+			else
+			{
+				src = &s_world->surfaceIndices[surface.patchLods[lod].firstIndex];
+				nIndices = surface.patchLods[lod].nIndices;
+			}
+
+			memcpy(&indices[firstLodIndex + nLodIndices], src, nIndices * sizeof(uint32_t));
+			nLodIndices += nIndices;
+		}
+
+		bs.nIndices = bs.nStaticIndices + nLodIndices;
+		bgfx::update(vis.indexBuffers[bs.bufferIndex].handle, firstLodIndex, CopyIndices(&indices[firstLodIndex], nLodIndices));
+	}
+}
+
 static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *areaMask)
 {
 	assert(areaMask);
@@ -1993,12 +2528,17 @@ static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const u
 	vis.method = VisibilityMethod::PVS;
 
 	// Get the PVS for the camera leaf cluster.
-	Node *cameraLeaf = LeafFromPosition(cameraPosition);
+	const Leaf *cameraLeaf = LeafFromPosition(cameraPosition);
 
 	// Build a list of visible surfaces.
 	// Don't need to refresh visible surfaces if the camera cluster or the area bitmask haven't changed.
 	if (vis.lastCameraLeaf != nullptr && vis.lastCameraLeaf->cluster == cameraLeaf->cluster && std::equal(areaMask, areaMask + MAX_MAP_AREA_BYTES, vis.lastAreaMask))
+	{
+		if (visId == VisibilityId::Main)
+			UpdatePatchLods(vis, cameraPosition);
+
 		return;
+	}
 
 	// Clear data that will be recalculated.
 	vis.portalSurfaces.clear();
@@ -2010,10 +2550,8 @@ static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const u
 	// A cluster of -1 means the camera is outside the PVS - draw everything.
 	const uint8_t *pvs = cameraLeaf->cluster == -1 ? nullptr: &s_world->visData[cameraLeaf->cluster * s_world->clusterBytes];
 
-	for (size_t i = s_world->firstLeaf; i < s_world->nodes.size(); i++)
+	for (const Leaf &leaf : s_world->leaves)
 	{
-		Node &leaf = s_world->nodes[i];
-
 		// Check PVS.
 		if (pvs && !(pvs[leaf.cluster >> 3] & (1 << (leaf.cluster & 7))))
 			continue;
@@ -2075,17 +2613,17 @@ static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const u
 	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
 	{
 		DynamicIndexBuffer &ib = vis.indexBuffers[i];
-		std::vector<uint16_t> &indices = vis.indices[i];
+		std::vector<uint32_t> &indices = vis.indices[i];
 
 		if (indices.empty())
 			continue;
 
-		const bgfx::Memory *mem = bgfx::copy(indices.data(), uint32_t(indices.size() * sizeof(uint16_t)));
+		const bgfx::Memory *mem = CopyIndices(indices);
 
 		// Buffer is created on first use.
 		if (!bgfx::isValid(ib.handle))
 		{
-			ib.handle = bgfx::createDynamicIndexBuffer(mem, BGFX_BUFFER_ALLOW_RESIZE);
+			ib.handle = bgfx::createDynamicIndexBuffer(mem, BGFX_BUFFER_ALLOW_RESIZE | IndexBufferFlags());
 		}
 		else				
 		{
@@ -2096,6 +2634,12 @@ static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const u
 	s_world->duplicateSurfaceId++;
 	vis.lastCameraLeaf = cameraLeaf;
 	memcpy(vis.lastAreaMask, areaMask, sizeof(vis.lastAreaMask));
+
+	// Batches were just created with patches at full detail. Only the main camera picks LODs, portals and reflections stay at full detail.
+	vis.surfacePatchLods.assign(vis.surfaces.size(), 0);
+
+	if (visId == VisibilityId::Main)
+		UpdatePatchLods(vis, cameraPosition);
 }
 
 static void UpdateCameraFrustumVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *areaMask)
@@ -2112,7 +2656,7 @@ static void UpdateCameraFrustumVisibility(VisibilityId visId, vec3 cameraPositio
 
 void UpdateVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *areaMask)
 {
-	if (visId == VisibilityId::Probe)
+	if (visId == VisibilityId::Probe || visId == VisibilityId::Shadow)
 	{
 		UpdateCameraFrustumVisibility(visId, cameraPosition, areaMask);
 	}
@@ -2143,10 +2687,24 @@ void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRot
 		cpuDeformIndices = &s_world->cpuDeformIndices;
 	}
 
+	const bool setStreamingPriority = g_textureCache->isStreaming() && visId == VisibilityId::Main;
+	const vec3 cameraPosition = main::GetMainCameraTransform().position;
+
 	for (const BatchedSurface &surface : *batchedSurfaces)
 	{
+		if (setStreamingPriority)
+		{
+			// Approximate the screen coverage of the surface bounds.
+			const vec3 center = surface.bounds.midpoint();
+			const float radius = surface.bounds.toSize().length() * 0.5f;
+			const float distance = (center - cameraPosition).length();
+			const float size = distance > radius ? radius / distance : 1.0f;
+			surface.material->setTextureStreamingPriority(size * size);
+		}
+
 		DrawCall dc;
-		dc.flags = 0;
+		dc.bounds = surface.bounds;
+		dc.flags = DrawCallFlags::HasBounds;
 
 		if (surface.surfaceFlags & SURF_SKY)
 			dc.flags |= DrawCallFlags::Sky;
@@ -2194,7 +2752,7 @@ void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRot
 		{
 			dc.vb.type = DrawCall::BufferType::Static;
 			dc.vb.staticHandle = s_world->vertexBuffers[surface.bufferIndex].handle;
-			dc.vb.nVertices = (uint32_t)s_world->vertices[surface.bufferIndex].size();
+			dc.vb.nVertices = GetNumVertices(surface.bufferIndex);
 
 			if (vis.method == VisibilityMethod::PVS)
 			{
@@ -2227,23 +2785,25 @@ void PickMaterial()
 		{
 			const Surface &surface = s_world->surfaces[model.firstSurface + si];
 
-			for (size_t i = 0; i < surface.indices.size(); i += 3)
+			const uint32_t *indices = surface.getIndices();
+
+			for (size_t i = 0; i < surface.nIndices; i += 3)
 			{
-				const Vertex *verts[3];
+				vec3 verts[3];
 
 				for (size_t vi = 0; vi < 3; vi++)
-					verts[vi] = &s_world->vertices[surface.bufferIndex][surface.indices[i + 2 - vi]];
+					verts[vi] = GetVertexPosition(surface.bufferIndex, indices[i + 2 - vi]);
 
 				// Fast Minimum Storage Ray/Triangle Intersection by Moller and Trumbore
-				const vec3 edge1 = verts[1]->pos - verts[0]->pos;
-				const vec3 edge2 = verts[2]->pos - verts[0]->pos;
+				const vec3 edge1 = verts[1] - verts[0];
+				const vec3 edge2 = verts[2] - verts[0];
 				const vec3 pvec = vec3::crossProduct(camera.rotation[0], edge2);
 				const float det = vec3::dotProduct(edge1, pvec);
 
 				if (det < 0.000001f)
 					continue;
 
-				const vec3 tvec = camera.position - verts[0]->pos;
+				const vec3 tvec = camera.position - verts[0];
 				const float u = vec3::dotProduct(tvec, pvec);
 
 				if (u < 0 || u > det)
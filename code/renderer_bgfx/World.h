@@ -225,6 +225,15 @@ struct BatchedSurface
 
 	/// @remarks Used by CPU deforms only.
 	uint32_t nVertices;
+
+	/// @brief Surfaces with patch LODs are sorted to the end of the batch, so their indices can be replaced when their LOD changes.
+	/// @remarks Index into the surface list the batch was created from.
+	uint32_t firstLodSurface = 0;
+
+	uint32_t nLodSurfaces = 0;
+
+	/// The number of indices before the first surface with patch LODs.
+	uint32_t nStaticIndices = 0;
 };
 
 struct CullInfoType
@@ -247,29 +256,23 @@ struct CullInfo
 	Plane plane;
 };
 
+/// @brief An entity key/value pair.
+/// @remarks Keys are interned, so lookups compare integers instead of strings.
 struct EntityKVP
 {
-	char key[128];
-	char value[128];
+	uint32_t key; // index into World::entityKeys
+	uint32_t value; // offset into World::entityStringPool
 };
 
 struct Entity
 {
-	std::array<EntityKVP, 32> kvps;
-	size_t nKvps;
-
-	const char *findValue(const char *key, const char *defaultValue = nullptr) const
-	{
-		for (size_t i = 0; i < nKvps; i++)
-		{
-			const EntityKVP &kvp = kvps[i];
+	uint32_t firstKvp; // index into World::entityKvps
+	uint32_t nKvps;
 
-			if (!util::Stricmp(kvp.key, key))
-				return kvp.value;
-		}
+	/// @brief Find the value for a key returned by FindEntityKey.
+	const char *findValue(int key, const char *defaultValue = nullptr) const;
 
-		return defaultValue;
-	}
+	const char *findValue(const char *key, const char *defaultValue = nullptr) const;
 };
 
 struct Fog
@@ -300,23 +303,40 @@ struct ModelDef
 	Bounds bounds;
 };
 
+/// @brief An inner BSP node, packed into 16 bytes so more of the tree fits in cache during point and box queries.
+/// @remarks Leaves are stored separately in World::leaves.
 struct Node
 {
-	// common with leaf and node
-	bool leaf;
-	Bounds bounds;
+	/// Index into World::planes.
+	int32_t plane;
+
+	/// Negative numbers are -(leaf + 1), not nodes.
+	int32_t children[2];
 
-	// node specific
-	Plane *plane;
-	Node *children[2];
+	/// 0-2 if the plane is axial, so point tests can skip the dot product. 3 otherwise.
+	uint8_t axis;
+
+	uint8_t pad[3];
+};
 
-	// leaf specific
+struct Leaf
+{
+	Bounds bounds;
 	int cluster;
 	int area;
 	int firstSurface; // index into leafSurfaces_
 	int nSurfaces;
 };
 
+static const size_t s_nPatchLods = 6;
+
+/// A range of World::surfaceIndices.
+struct PatchLod
+{
+	uint32_t firstIndex;
+	uint32_t nIndices;
+};
+
 enum class SurfaceType
 {
 	Ignore, /// Ignore this surface when rendering. e.g. material has SURF_NODRAW surfaceFlags 
@@ -339,7 +359,14 @@ struct Surface
 	int fogIndex;
 	int flags; // SURF *
 	int contentFlags;
-	std::vector<uint16_t> indices;
+
+	/// @brief A range of World::surfaceIndices. Absolute indices into the geometry buffer.
+	/// @remarks Surfaces are laid out in batch order, so surfaces that are batched together are usually contiguous.
+	uint32_t firstIndex = 0;
+
+	uint32_t nIndices = 0;
+
+	const uint32_t *getIndices() const;
 
 	/// Which geometry buffer to use.
 	size_t bufferIndex;
@@ -349,17 +376,28 @@ struct Surface
 	// SurfaceType::Patch
 	Patch *patch = nullptr;
 
+	/// @brief Whether the patch has precomputed LOD index sets. False if the patch has a single LOD.
+	bool hasPatchLods = false;
+
+	/// @brief Ranges of World::surfaceIndices. Absolute indices into the geometry buffer, like the surface indices.
+	/// @remarks LOD 0 is full detail and uses the surface indices, as does any LOD with nIndices 0. LODs that don't remove any more rows or columns share the previous LOD's range.
+	std::array<PatchLod, s_nPatchLods> patchLods;
+
 	/// Used at runtime to avoid adding duplicate visible surfaces.
 	int duplicateId = -1;
 
 	/// Used at runtime to avoid processing surfaces multiple times when adding a decal.
 	int decalDuplicateId = -1;
 
-	/// @remarks Used by CPU deforms only.
+	/// @remarks Used by CPU deforms, portals and reflective surfaces.
 	uint32_t firstVertex;
 
-	/// @remarks Used by CPU deforms only.
+	/// @remarks Used by CPU deforms, portals and reflective surfaces.
 	uint32_t nVertices;
+
+	/// @brief A copy of the surface vertices, for surfaces that need more than positions after the world geometry is compacted.
+	/// @remarks Only set when World::compactGeometry is. Index with indices minus firstVertex.
+	std::vector<Vertex> vertices;
 };
 
 static const size_t s_maxWorldGeometryBuffers = 8;
@@ -404,11 +442,11 @@ struct Visibility
 	DynamicIndexBuffer indexBuffers[s_maxWorldGeometryBuffers];
 
 	/// Temporary index data populated at runtime when surface visibility changes.
-	std::vector<uint16_t> indices[s_maxWorldGeometryBuffers];
+	std::vector<uint32_t> indices[s_maxWorldGeometryBuffers];
 
 	/// The camera leaf from the last UpdateVisibility call.
 	/// @remarks Visibility is only recalculated if the camera leaf cluster or area mask changes.
-	Node *lastCameraLeaf = nullptr;
+	const Leaf *lastCameraLeaf = nullptr;
 
 	/// The area mask from the last UpdateVisibility call.
 	/// @remarks Visibility is only recalculated if the camera leaf cluster or area mask changes.
@@ -426,6 +464,9 @@ struct Visibility
 
 	/// Surfaces visible from the camera leaf cluster.
 	std::vector<Surface *> surfaces;
+
+	/// The current LOD of each surface in surfaces. Only used by surfaces with patch LODs.
+	std::vector<uint8_t> surfacePatchLods;
 };
 
 struct World
@@ -436,6 +477,13 @@ struct World
 	std::vector<char> entityString;
 	char *entityParsePoint = nullptr;
 	std::vector<Entity> entities;
+	std::vector<EntityKVP> entityKvps;
+
+	/// Offsets into entityStringPool, one per unique (case insensitive) key.
+	std::vector<uint32_t> entityKeys;
+
+	/// Null terminated entity keys and values.
+	std::vector<char> entityStringPool;
 	std::vector<Fog> fogs;
 	const int lightmapSize = 128;
 	vec2i lightmapAtlasSize; // In cells. e.g. 2x2 is 256x256 (lightmapSize).
@@ -453,20 +501,34 @@ struct World
 	/// All model surfaces.
 	std::vector<Surface> surfaces;
 
+	/// @brief Index storage for all surfaces, including patch LODs.
+	/// @remarks Populated at load time and never resized after, so it's freed as a single block.
+	std::vector<uint32_t> surfaceIndices;
+
 	VertexBuffer vertexBuffers[s_maxWorldGeometryBuffers];
 
 	/// Vertex data populated at load time.
+	/// @remarks Freed after upload if compactGeometry is set.
 	std::vector<Vertex> vertices[s_maxWorldGeometryBuffers];
 
+	/// Vertex positions, kept instead of vertices when compactGeometry is set.
+	std::vector<vec3> vertexPositions[s_maxWorldGeometryBuffers];
+
+	/// The CPU copy of the world vertices was freed after upload to save memory. See r_compactWorldGeometry.
+	/// @remarks Only positions are kept for everything but the surfaces that need full vertex data, e.g. CPU deforms.
+	bool compactGeometry = false;
+
 	/// Incremented when a surface won't fit in the current geometry buffer (16-bit indices).
 	size_t currentGeometryBuffer = 0;
 
+	/// Index buffers use 32-bit indices, so all geometry fits in the first geometry buffer.
+	/// @remarks Set when the renderer backend supports 32-bit indices.
+	bool index32 = false;
+
 	std::vector<Node> nodes;
+	std::vector<Leaf> leaves;
 	std::vector<int> leafSurfaces;
 
-	/// Index into nodes_ for the first leaf.
-	size_t firstLeaf;
-
 	int nClusters;
 	int clusterBytes;
 	const uint8_t *visData = nullptr;
@@ -489,12 +551,21 @@ struct World
 
 extern std::unique_ptr<World> s_world;
 
-Node *LeafFromPosition(vec3 pos);
+const Leaf *LeafFromPosition(vec3 pos);
+
+/// @brief Get the interned id of an entity key.
+/// @return -1 if no entity in the world uses the key.
+int FindEntityKey(const char *key);
+
 int GetNumModels();
 int GetNumSurfaces(int modelIndex);
 const Surface &GetSurface(int modelIndex, int surfaceIndex);
 int GetNumVertexBuffers();
+
+/// @remarks Empty if the world geometry has been compacted.
 const std::vector<Vertex> &GetVertexBuffer(int index);
 
+bool IsGeometryCompact();
+
 } // namespace world
 } // namespace renderer
@@ -176,6 +176,11 @@ newaction
 			{ "SunLight", "USE_SUN_LIGHT" }
 		}
 		
+		local smaaNeighborhoodBlendingFragmentVariants =
+		{
+			{ "Bloom", "USE_BLOOM" }
+		}
+		
 		local textureVariationFragmentVariants =
 		{
 			{ "SunLight", "USE_SUN_LIGHT" }
@@ -193,7 +198,8 @@ newaction
 			{ "HemicubeWeightedDownsample" },
 			{ "SMAABlendingWeightCalculation" },
 			{ "SMAAEdgeDetection" },
-			{ "SMAANeighborhoodBlending" },
+			{ "SMAANeighborhoodBlending", smaaNeighborhoodBlendingFragmentVariants },
+			{ "Skybox" },
 			{ "Texture" },
 			{ "TextureColor" },
 			{ "TextureDebug" },
@@ -209,6 +215,7 @@ newaction
 			{ "SMAABlendingWeightCalculation" },
 			{ "SMAAEdgeDetection" },
 			{ "SMAANeighborhoodBlending" },
+			{ "Skybox" },
 			{ "Texture" }
 		}
 		
@@ -303,6 +310,7 @@ newaction
 		writeShaderVariantEnum(outputHeaderFile, genericFragmentVariants, "GenericFragment")
 		writeShaderVariantEnum(outputHeaderFile, depthFragmentVariants, "DepthFragment")
 		writeShaderVariantEnum(outputHeaderFile, depthVertexVariants, "DepthVertex")
+		writeShaderVariantEnum(outputHeaderFile, smaaNeighborhoodBlendingFragmentVariants, "SMAANeighborhoodBlendingFragment")
 		writeShaderVariantEnum(outputHeaderFile, textureVariationFragmentVariants, "TextureVariationFragment")
 		outputHeaderFile:close()
 
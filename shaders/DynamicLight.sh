@@ -5,7 +5,9 @@ SAMPLER2D(u_DynamicLightsSampler, 6); // TU_DYNAMIC_LIGHTS
 
 uniform vec4 u_DynamicLightCellSize; // xyz is size
 uniform vec4 u_DynamicLightGridOffset; // w not used
-uniform vec4 u_DynamicLightGridSize; // w not used
+uniform vec4 u_DynamicLightGridSize; // w is 1 if using view space clusters
+uniform vec4 u_DynamicLightClusterSize; // xy screen tiles, z depth slices, w offset of the first cluster in the cells texture
+uniform vec4 u_DynamicLightClusterDepth; // x depth that exponential slicing starts from, y slices / log(far / near)
 uniform vec4 u_DynamicLight_Num_Intensity; // x is the number of dynamic lights, y is the intensity scale
 uniform vec4 u_DynamicLightTextureSizes_Cells_Indices_Lights; // w not used
 
@@ -32,13 +34,28 @@ DynamicLight GetDynamicLight(uint index)
 	return dl;
 }
 
-uint GetDynamicLightIndicesOffset(vec3 position)
+uint GetDynamicLightIndicesOffset(vec3 position, vec4 projPosition)
 {
-	vec3 local = u_DynamicLightGridOffset.xyz + position;
-	uint cellX = min(uint(max(0, local.x / u_DynamicLightCellSize.x)), uint(u_DynamicLightGridSize.x) - 1u);
-	uint cellY = min(uint(max(0, local.y / u_DynamicLightCellSize.y)), uint(u_DynamicLightGridSize.y) - 1u);
-	uint cellZ = min(uint(max(0, local.z / u_DynamicLightCellSize.z)), uint(u_DynamicLightGridSize.z) - 1u);
-	uint cellOffset = cellX + (cellY * uint(u_DynamicLightGridSize.x)) + (cellZ * uint(u_DynamicLightGridSize.x) * uint(u_DynamicLightGridSize.y));
+	uint cellOffset;
+
+	if (u_DynamicLightGridSize.w > 0.5)
+	{
+		// View space clusters. Screen tiles, and depth slices that get exponentially deeper.
+		vec2 ndc = projPosition.xy / projPosition.w;
+		uint clusterX = uint(clamp((ndc.x * 0.5 + 0.5) * u_DynamicLightClusterSize.x, 0.0, u_DynamicLightClusterSize.x - 1.0));
+		uint clusterY = uint(clamp((ndc.y * 0.5 + 0.5) * u_DynamicLightClusterSize.y, 0.0, u_DynamicLightClusterSize.y - 1.0));
+		uint clusterZ = uint(clamp(log(max(projPosition.w / u_DynamicLightClusterDepth.x, 1.0)) * u_DynamicLightClusterDepth.y, 0.0, u_DynamicLightClusterSize.z - 1.0));
+		cellOffset = uint(u_DynamicLightClusterSize.w) + clusterX + (clusterY * uint(u_DynamicLightClusterSize.x)) + (clusterZ * uint(u_DynamicLightClusterSize.x) * uint(u_DynamicLightClusterSize.y));
+	}
+	else
+	{
+		vec3 local = u_DynamicLightGridOffset.xyz + position;
+		uint cellX = min(uint(max(0, local.x / u_DynamicLightCellSize.x)), uint(u_DynamicLightGridSize.x) - 1u);
+		uint cellY = min(uint(max(0, local.y / u_DynamicLightCellSize.y)), uint(u_DynamicLightGridSize.y) - 1u);
+		uint cellZ = min(uint(max(0, local.z / u_DynamicLightCellSize.z)), uint(u_DynamicLightGridSize.z) - 1u);
+		cellOffset = cellX + (cellY * uint(u_DynamicLightGridSize.x)) + (cellZ * uint(u_DynamicLightGridSize.x) * uint(u_DynamicLightGridSize.y));
+	}
+
 	int u = int(cellOffset) % int(u_DynamicLightTextureSizes_Cells_Indices_Lights.x);
 	int v = int(cellOffset) / int(u_DynamicLightTextureSizes_Cells_Indices_Lights.x);
 	return texelFetch(u_DynamicLightCellsSampler, ivec2(u, v), 0).r;
@@ -63,41 +80,48 @@ vec3 ClosestPointOnLineSegment(vec3 A, vec3 B, vec3 P)
 	return A + AB * saturate(distance);
 }
 
-vec3 CalculateDynamicLight(vec3 position, vec3 normal)
+uint GetDynamicLightCount(vec3 position, vec4 projPosition)
+{
+	if (int(u_DynamicLight_Num_Intensity.x) == 0)
+		return 0u;
+
+	uint indicesOffset = GetDynamicLightIndicesOffset(position, projPosition);
+
+	if (indicesOffset == 0u) // First index is reserved for empty cells.
+		return 0u;
+
+	return GetDynamicLightIndicesData(indicesOffset);
+}
+
+// Used by RENDER_MODE_DYNAMIC_LIGHT_COUNT.
+vec3 DynamicLightCountHeatmap(uint numLights)
+{
+	if (numLights == 0u)
+		return vec3(0.0, 0.0, 0.0);
+	else if (numLights == 1u)
+		return vec3(0.0, 0.0, 1.0);
+	else if (numLights == 2u)
+		return vec3(0.0, 1.0, 1.0);
+	else if (numLights == 3u)
+		return vec3(0.0, 1.0, 0.0);
+	else if (numLights == 4u)
+		return vec3(1.0, 1.0, 0.0);
+
+	return vec3(1.0, 0.0, 0.0);
+}
+
+vec3 CalculateDynamicLight(vec3 position, vec4 projPosition, vec3 normal)
 {
 	vec3 diffuseLight = vec3_splat(0.0);
 
 	if (int(u_DynamicLight_Num_Intensity.x) > 0)
 	{
-		uint indicesOffset = GetDynamicLightIndicesOffset(position);
+		uint indicesOffset = GetDynamicLightIndicesOffset(position, projPosition);
 
 		if (indicesOffset > 0u) // First index is reserved for empty cells.
 		{
 			uint numLights = GetDynamicLightIndicesData(indicesOffset);
 
-#if 0
-			// Heatmap
-			if (numLights == 1u)
-			{
-				diffuseLight = vec3(0.0, 0.0, 1.0);
-			}
-			else if (numLights == 2u)
-			{
-				diffuseLight = vec3(0.0, 1.0, 1.0);
-			}
-			else if (numLights == 3u)
-			{
-				diffuseLight = vec3(0.0, 1.0, 0.0);
-			}
-			else if (numLights == 4u)
-			{
-				diffuseLight = vec3(1.0, 1.0, 0.0);
-			}
-			else if (numLights >= 5u)
-			{
-				diffuseLight = vec3(1.0, 0.0, 0.0);
-			}
-#else
 			for (uint i = 0u; i < numLights; i++)
 			{
 				uint lightIndex = GetDynamicLightIndicesData(indicesOffset + 1u + i);
@@ -118,7 +142,6 @@ vec3 CalculateDynamicLight(vec3 position, vec3 normal)
 				float attenuation = min(2.0 * inverseNormalizedDistance, 1.0); // 1 at top half, lerp between 1 and 0 at bottom half
 				diffuseLight += light.color_radius.rgb * attenuation * Lambert(normal, normalize(dir)) * u_DynamicLight_Num_Intensity.y;
 			}
-#endif
 		}
 	}
 
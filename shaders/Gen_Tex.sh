@@ -12,3 +12,15 @@ vec2 ModTexCoords(vec2 st, vec3 position, vec4 texMatrix, vec4 offTurb)
 	
 	return st2 + texOffset * amplitude;	
 }
+
+// Sky cloud layer texture coordinates. Intersects the view direction with a sphere around the viewer, radiusWorld below the viewer with the cloud height added.
+vec2 SkyCloudTexCoords(vec3 dir, float cloudHeight)
+{
+	const float radiusWorld = 4096.0;
+	dir = normalize(dir);
+	float p = -dir.z * radiusWorld + sqrt(dir.z * dir.z * radiusWorld * radiusWorld + 2.0 * radiusWorld * cloudHeight + cloudHeight * cloudHeight);
+	vec3 v = dir * p;
+	v.z += radiusWorld;
+	v = normalize(v);
+	return vec2(acos(v.x), acos(v.y));
+}
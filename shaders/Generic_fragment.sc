@@ -4,6 +4,7 @@ $input v_position, v_projPosition, v_shadowPosition, v_texcoord0, v_texcoord1, v
 #include "Common.sh"
 #include "SharedDefines.sh"
 #include "AlphaTest.sh"
+#include "Gen_Tex.sh"
 #include "DynamicLight.sh"
 #include "PortalClip.sh"
 #include "SunLight.sh"
@@ -32,6 +33,11 @@ uniform vec4 u_Generators;
 #define u_ColorGen int(u_Generators[GEN_COLOR])
 #define u_AlphaGen int(u_Generators[GEN_ALPHA])
 
+// tcgen and tcmod for TCGEN_SKY_CLOUD
+uniform vec4 u_TCGen0Vector0; // x is cloud height
+uniform vec4 u_DiffuseTexMatrix;
+uniform vec4 u_DiffuseTexOffTurb;
+
 // light vector
 uniform vec4 u_LightDirection;
 uniform vec4 u_DirectedLight;
@@ -39,6 +45,11 @@ uniform vec4 u_AmbientLight;
 
 uniform vec4 u_LightType; // only x used
 
+// fog blended by the last stage of opaque materials, instead of a separate fog pass
+uniform vec4 u_FogEnabled; // only y used
+uniform vec4 u_FogColor;
+#define v_fogScale v_normal.w
+
 void main()
 {
 	if (PortalClipped(v_position))
@@ -50,6 +61,16 @@ void main()
 	{
 		texCoord0 = gl_FragCoord.xy * u_viewTexel.xy;
 	}
+	else if (u_TexCoordGen == TCGEN_SKY_CLOUD)
+	{
+		vec3 dir = v_position - u_ViewOrigin.xyz;
+
+		// Don't draw clouds beneath the viewer.
+		if (-dir.z > max(abs(dir.x), abs(dir.y)))
+			discard;
+
+		texCoord0 = ModTexCoords(SkyCloudTexCoords(dir, u_TCGen0Vector0.x), dir, u_DiffuseTexMatrix, u_DiffuseTexOffTurb);
+	}
 
 	vec4 diffuse = texture2D(u_DiffuseSampler, texCoord0);
 
@@ -127,11 +148,11 @@ void main()
 		vertexColor = vec3_splat(1.0);
 	}
 
-	diffuseLight += CalculateDynamicLight(v_position, v_normal.xyz);
+	diffuseLight += CalculateDynamicLight(v_position, v_projPosition, v_normal.xyz);
 #endif // USE_DYNAMIC_LIGHTS
 
 #if defined(USE_SUN_LIGHT)
-	diffuseLight += CalculateSunLight(v_position, v_normal.xyz, v_shadowPosition);
+	diffuseLight += CalculateSunLight(v_position, v_normal.xyz, v_shadowPosition, v_projPosition.w);
 #endif
 
 	vec4 fragColor = vec4(ToGamma(diffuse.rgb * vertexColor * diffuseLight), alpha);
@@ -146,14 +167,28 @@ void main()
 	{
 		fragColor = vec4(texture2D(u_LightSampler, v_texcoord1).rgb, alpha);
 	}
+#if defined(USE_DYNAMIC_LIGHTS)
+	else if (renderMode == RENDER_MODE_DYNAMIC_LIGHT_COUNT)
+	{
+		fragColor = vec4(DynamicLightCountHeatmap(GetDynamicLightCount(v_position, v_projPosition)), alpha);
+	}
+#endif
+
+	float fogAlpha = 0.0;
+
+	if (int(u_FogEnabled.y) != 0)
+	{
+		fogAlpha = sqrt(saturate(v_fogScale));
+	}
 
-	gl_FragData[0] = fragColor;
+	gl_FragData[0] = vec4(mix(fragColor.rgb, u_FogColor.rgb, fogAlpha), fragColor.a);
 
 	if (u_BloomEnabled != 0)
 	{
 		if (u_BloomWrite != 0)
 		{
-			gl_FragData[1] = fragColor;
+			// The fog pass blends the bloom target towards black.
+			gl_FragData[1] = vec4(fragColor.rgb * (1.0 - fogAlpha), fragColor.a);
 		}
 		else
 		{
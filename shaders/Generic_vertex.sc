@@ -1,4 +1,4 @@
-$input a_position, a_normal, a_tangent, a_texcoord0, a_color0
+$input a_position, a_normal, a_tangent, a_texcoord0, a_texcoord1, a_color0
 $output v_position, v_projPosition, v_shadowPosition, v_texcoord0, v_texcoord1, v_normal, v_color0
 
 /*
@@ -56,12 +56,15 @@ uniform vec4 u_DiffuseTexOffTurb;
 // colorgen and alphagen
 uniform vec4 u_PortalRange;
 
-uniform vec4 u_FogEnabled; // only x used
+uniform vec4 u_FogEnabled; // only x and y used
+uniform vec4 u_FogColor;
 uniform vec4 u_FogColorMask;
 uniform vec4 u_FogDepth;
 uniform vec4 u_FogDistance;
 uniform vec4 u_FogEyeT; // only x used
 
+#define v_fogScale v_normal.w
+
 vec2 GenTexCoords(vec3 position, vec3 normal, vec2 texCoord1, vec2 texCoord2)
 {
 	vec2 tex = texCoord1;
@@ -119,7 +122,7 @@ void main()
 
 	if (u_TCGen0 != TCGEN_NONE)
 	{
-		vec2 tex = GenTexCoords(position, normal, a_texcoord0.xy, a_texcoord0.zw);
+		vec2 tex = GenTexCoords(position, normal, a_texcoord0.xy, a_texcoord1);
 		v_texcoord0 = ModTexCoords(tex, position, u_DiffuseTexMatrix, u_DiffuseTexOffTurb);
 	}
 	else
@@ -136,15 +139,23 @@ void main()
 		v_color0 = u_VertColor * a_color0 + u_BaseColor;
 	}
 
+	float fogScale = 0.0;
+
+	if (int(u_FogEnabled.x) != 0 || int(u_FogEnabled.y) != 0)
+	{
+		fogScale = CalcFog(position, u_FogDepth, u_FogDistance, u_FogEyeT.x);
+	}
+
 	if (int(u_FogEnabled.x) != 0)
 	{
-		v_color0 *= vec4_splat(1.0) - u_FogColorMask * sqrt(saturate(CalcFog(position, u_FogDepth, u_FogDistance, u_FogEyeT.x)));
+		v_color0 *= vec4_splat(1.0) - u_FogColorMask * sqrt(saturate(fogScale));
 	}
 
 	vec3 wsPosition = mul(u_model[0], vec4(position, 1.0)).xyz;
-	v_texcoord1 = a_texcoord0.zw;
+	v_texcoord1 = a_texcoord1;
 	v_position = wsPosition;
 	v_normal = mul(u_model[0], vec4(normal, 0.0));
+	v_fogScale = fogScale * u_FogColor.a * u_FogColor.a;
 	v_projPosition = mul(u_viewProj, vec4(v_position, 1.0));
 	if (int(u_DepthRangeEnabled.x) != 0)
 		v_projPosition = ApplyDepthRange(v_projPosition, u_DepthRange.x, u_DepthRange.y);
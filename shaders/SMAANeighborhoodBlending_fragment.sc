@@ -9,11 +9,25 @@ $input v_texcoord0, v_texcoord2
 SAMPLER2D(u_SmaaColorSampler, 0);
 SAMPLER2D(u_SmaaBlendSampler, 1);
 
+#if defined(USE_BLOOM)
+SAMPLER2D(u_BloomSampler, 2);
+
+uniform vec4 u_Bloom_Enabled_Write_Scale;
+#define u_BloomScale u_Bloom_Enabled_Write_Scale.z
+#endif
+
 void main()
 {
 #if BGFX_SHADER_LANGUAGE_HLSL
-	gl_FragColor = SMAANeighborhoodBlendingPS(v_texcoord0, v_texcoord2, u_SmaaColorSampler.m_texture, u_SmaaBlendSampler.m_texture);
+	vec4 color = SMAANeighborhoodBlendingPS(v_texcoord0, v_texcoord2, u_SmaaColorSampler.m_texture, u_SmaaBlendSampler.m_texture);
 #else
-	gl_FragColor = SMAANeighborhoodBlendingPS(v_texcoord0, v_texcoord2, u_SmaaColorSampler, u_SmaaBlendSampler);
+	vec4 color = SMAANeighborhoodBlendingPS(v_texcoord0, v_texcoord2, u_SmaaColorSampler, u_SmaaBlendSampler);
 #endif
+
+#if defined(USE_BLOOM)
+	// Bloom is low frequency, so adding it after antialiasing is the same as antialiasing the bloomed scene.
+	color = vec4(color.rgb + texture2D(u_BloomSampler, v_texcoord0).rgb * u_BloomScale, 1.0);
+#endif
+
+	gl_FragColor = color;
 }
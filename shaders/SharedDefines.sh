@@ -38,9 +38,10 @@
 
 #define MAX_DEFORMS 3
 
-#define RENDER_MODE_NONE     0
-#define RENDER_MODE_LIT      1
-#define RENDER_MODE_LIGHTMAP 2
+#define RENDER_MODE_NONE                0
+#define RENDER_MODE_LIT                 1
+#define RENDER_MODE_LIGHTMAP            2
+#define RENDER_MODE_DYNAMIC_LIGHT_COUNT 3
 
 #define RGBM_MAX_RANGE 8.0
 
@@ -51,6 +52,7 @@
 #define TCGEN_LIGHTMAP           4
 #define TCGEN_TEXTURE            5
 #define TCGEN_VECTOR             6
+#define TCGEN_SKY_CLOUD          7
 
 #define TEXTURE_DEBUG_R    0
 #define TEXTURE_DEBUG_G    1
@@ -67,5 +69,6 @@
 #define TU_DYNAMIC_LIGHTS        6
 #define TU_SHADOWMAP             7
 #define TU_NOISE                 8
+#define TU_SKYBOX                0 // Skybox shader only. 6 units, one per side.
 
 #define USE_HALF_LAMBERT
\ No newline at end of file
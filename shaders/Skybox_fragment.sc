@@ -0,0 +1,93 @@
+$input v_position, v_projPosition
+
+#include <bgfx_shader.sh>
+#include "Common.sh"
+#include "SharedDefines.sh"
+#include "PortalClip.sh"
+
+// TU_SKYBOX, one per side.
+SAMPLER2D(u_SkyboxSampler0, 0); // +x
+SAMPLER2D(u_SkyboxSampler1, 1); // -x
+SAMPLER2D(u_SkyboxSampler2, 2); // +y
+SAMPLER2D(u_SkyboxSampler3, 3); // -y
+SAMPLER2D(u_SkyboxSampler4, 4); // +z
+SAMPLER2D(u_SkyboxSampler5, 5); // -z
+
+uniform vec4 u_Bloom_Enabled_Write_Scale;
+#define u_BloomEnabled int(u_Bloom_Enabled_Write_Scale.x)
+
+uniform vec4 u_RenderMode; // only x used
+uniform vec4 u_ViewOrigin;
+
+void main()
+{
+	if (PortalClipped(v_position))
+		discard;
+
+	// Pick the box side from the major axis of the view direction.
+	// s and t are the other two axes divided by the major one, matching the vanilla sky box tessellation.
+	vec3 dir = v_position - u_ViewOrigin.xyz;
+	vec3 absDir = abs(dir);
+	vec3 sAxis, tAxis, majorAxis;
+	int side;
+
+	if (absDir.x >= absDir.y && absDir.x >= absDir.z)
+	{
+		side = dir.x > 0.0 ? 0 : 1;
+		sAxis = vec3(0.0, dir.x > 0.0 ? -1.0 : 1.0, 0.0);
+		tAxis = vec3(0.0, 0.0, 1.0);
+		majorAxis = vec3(sign(dir.x), 0.0, 0.0);
+	}
+	else if (absDir.y >= absDir.z)
+	{
+		side = dir.y > 0.0 ? 2 : 3;
+		sAxis = vec3(dir.y > 0.0 ? 1.0 : -1.0, 0.0, 0.0);
+		tAxis = vec3(0.0, 0.0, 1.0);
+		majorAxis = vec3(0.0, sign(dir.y), 0.0);
+	}
+	else
+	{
+		side = dir.z > 0.0 ? 4 : 5;
+		sAxis = vec3(0.0, -1.0, 0.0);
+		tAxis = vec3(dir.z > 0.0 ? -1.0 : 1.0, 0.0, 0.0);
+		majorAxis = vec3(0.0, 0.0, sign(dir.z));
+	}
+
+	float major = dot(dir, majorAxis);
+	vec2 st = vec2(dot(dir, sAxis), dot(dir, tAxis)) / major;
+	vec2 texCoord = vec2(st.x * 0.5 + 0.5, 0.5 - st.y * 0.5);
+
+	// Explicit gradients from the view direction, which is continuous across sides, so mip selection doesn't break at the seams.
+	vec3 dirDx = dFdx(dir);
+	vec3 dirDy = dFdy(dir);
+	vec2 texCoordDx = (vec2(dot(dirDx, sAxis), dot(dirDx, tAxis)) - st * dot(dirDx, majorAxis)) / major * vec2(0.5, -0.5);
+	vec2 texCoordDy = (vec2(dot(dirDy, sAxis), dot(dirDy, tAxis)) - st * dot(dirDy, majorAxis)) / major * vec2(0.5, -0.5);
+	vec4 diffuse;
+
+	if (side == 0)
+		diffuse = texture2DGrad(u_SkyboxSampler0, texCoord, texCoordDx, texCoordDy);
+	else if (side == 1)
+		diffuse = texture2DGrad(u_SkyboxSampler1, texCoord, texCoordDx, texCoordDy);
+	else if (side == 2)
+		diffuse = texture2DGrad(u_SkyboxSampler2, texCoord, texCoordDx, texCoordDy);
+	else if (side == 3)
+		diffuse = texture2DGrad(u_SkyboxSampler3, texCoord, texCoordDx, texCoordDy);
+	else if (side == 4)
+		diffuse = texture2DGrad(u_SkyboxSampler4, texCoord, texCoordDx, texCoordDy);
+	else
+		diffuse = texture2DGrad(u_SkyboxSampler5, texCoord, texCoordDx, texCoordDy);
+
+	vec4 fragColor = vec4(diffuse.rgb, 1.0);
+
+	if (int(u_RenderMode.x) == RENDER_MODE_LIT)
+	{
+		fragColor = vec4(0.0, 0.0, 0.0, 1.0);
+	}
+
+	gl_FragData[0] = fragColor;
+
+	if (u_BloomEnabled != 0)
+	{
+		gl_FragData[1] = vec4(0.0, 0.0, 0.0, fragColor.a);
+	}
+}
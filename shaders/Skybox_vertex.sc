@@ -0,0 +1,14 @@
+$input a_position
+$output v_position, v_projPosition
+
+#include <bgfx_shader.sh>
+#include "Common.sh"
+
+uniform vec4 u_DepthRange;
+
+void main()
+{
+	v_position = mul(u_model[0], vec4(a_position, 1.0)).xyz;
+	v_projPosition = ApplyDepthRange(mul(u_viewProj, vec4(v_position, 1.0)), u_DepthRange.x, u_DepthRange.y);
+	gl_Position = v_projPosition;
+}
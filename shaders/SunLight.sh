@@ -9,16 +9,34 @@ SAMPLER2DSHADOW(u_ShadowMapSampler, 7); // TU_SHADOWMAP
 uniform vec4 u_SunLightColor;
 uniform vec4 u_SunLightDir;
 uniform vec4 u_ShadowMap_TexelSize_DepthBias_NormalBias_SlopeScaleDepthBias;
+uniform vec4 u_ShadowCascadeSplits; // view depth of the far end of each cascade
+uniform vec4 u_ShadowCascadeScaleOffset[4]; // xy scale, zw offset from u_LightModelViewProj clip space to a cascade in the shadow map
 #define u_ShadowMapTexelSize u_ShadowMap_TexelSize_DepthBias_NormalBias_SlopeScaleDepthBias.x
 #define u_ShadowMapDepthBias u_ShadowMap_TexelSize_DepthBias_NormalBias_SlopeScaleDepthBias.y
 #define u_ShadowMapSlopeScaleDepthBias u_ShadowMap_TexelSize_DepthBias_NormalBias_SlopeScaleDepthBias.w
 
-vec3 CalculateSunLight(vec3 position, vec3 normal, vec4 shadowPosition)
+vec3 CalculateSunLight(vec3 position, vec3 normal, vec4 shadowPosition, float viewDepth)
 {
 	if (shadowPosition.w <= 0.0)
 		return vec3_splat(0.0);
 
+	// Unused cascade splits are the same as the last used one, so fragments past the last cascade get 4 and are unshadowed.
+	float cascade = 4.0 - dot(step(vec4_splat(viewDepth), u_ShadowCascadeSplits), vec4_splat(1.0));
+
+	if (cascade > 3.5)
+		return u_SunLightColor.rgb;
+
+	vec4 scaleOffset = u_ShadowCascadeScaleOffset[0];
+
+	if (cascade > 2.5)
+		scaleOffset = u_ShadowCascadeScaleOffset[3];
+	else if (cascade > 1.5)
+		scaleOffset = u_ShadowCascadeScaleOffset[2];
+	else if (cascade > 0.5)
+		scaleOffset = u_ShadowCascadeScaleOffset[1];
+
 	vec3 lsPosition = shadowPosition.xyz / shadowPosition.w;
+	lsPosition.xy = lsPosition.xy * scaleOffset.xy + scaleOffset.zw;
 	lsPosition.x = lsPosition.x * 0.5 + 0.5;
 	lsPosition.y = lsPosition.y * 0.5 + 0.5;
 #if BGFX_SHADER_LANGUAGE_HLSL
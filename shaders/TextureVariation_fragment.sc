@@ -80,9 +80,9 @@ void main()
 	float alpha = diffuse.a * v_color0.a;;
 	vec3 vertexColor = v_color0.rgb;
 	vec3 diffuseLight = ToLinear(texture2D(u_LightSampler, v_texcoord1).rgb);
-	diffuseLight += CalculateDynamicLight(v_position, v_normal.xyz);
+	diffuseLight += CalculateDynamicLight(v_position, v_projPosition, v_normal.xyz);
 #if defined(USE_SUN_LIGHT)
-	diffuseLight += CalculateSunLight(v_position, v_normal.xyz, v_shadowPosition);
+	diffuseLight += CalculateSunLight(v_position, v_normal.xyz, v_shadowPosition, v_projPosition.w);
 #endif
 	vec4 fragColor = vec4(ToGamma(diffuse.rgb * vertexColor * diffuseLight), alpha);
 	if (int(u_RenderMode.x) == RENDER_MODE_LIGHTMAP)